@@ -0,0 +1,1054 @@
+// Headless benchmark for the layout. Doesn't open a window, so it can run on a build server.
+//
+// Builds synthetic trees of 1k to 1M items, and times `add_item` (building the tree) and `do_layout` separately,
+// along with the number of allocations and the peak heap usage of each phase. Every frame builds a new layout from
+// scratch. At the end, this is compared with resetting one layout every frame, the way main.cpp does it, and a
+// virtual list with max_items rows, and a panel of up to 100k items, are scrolled through. Finally, hit tests are
+// timed on each tree.
+//
+// Each tree is also laid out on a thread pool with one worker per hardware thread, and compared with laying it out on
+// the calling thread.
+//
+// The hot/cold run lays out up to 1000 wrapping rows of 100 flex items, with and without a render callback and
+// userdata on every item, starting each frame from an empty cache. The callbacks live in a separate table from the
+// configs that the row splitting and flex loops stream through, so both times should be about the same. This only
+// shows the effect of the split on time: the cache misses aren't counted, run the bench under
+// `perf stat -e cache-misses,cache-references` for those.
+//
+// Building on Linux:
+//   g++ -O2 -std=c++20 -DNDEBUG -pthread flexy_bench.cpp flexy_layout.cpp flexy_thread_pool.cpp -o flexy_bench
+//
+// Add -DFLEXY_STATS=1 to also print where the do_layout time goes.
+//
+// Usage: flexy_bench [max_items] [tree name]
+//        flexy_bench --check-allocs [item_count]
+//        flexy_bench --check-render
+//
+// --check-allocs rebuilds every tree in one layout, which is reset every frame, and counts the heap allocations made
+// by do_layout, both computing the layout and rendering it, once the layout has been warmed up. Every tree is run with
+// both traversal orders, with and without a thread pool. Exits with 1 if there were any, so it can be run as a test.
+//
+// --check-render checks that an item that overflows its parent into a clipping panel is drawn and hit, when the
+// parent itself is scrolled out of view. Exits with 1 if it isn't.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include "flexy_layout.hpp"
+#include "flexy_thread_pool.hpp"
+
+//=======================================================================================
+// Heap tracking. Every allocation is prefixed with its size, so the number of live bytes can be tracked. The counters
+// are atomic, as the workers of the thread pool allocate too
+namespace {
+    struct heap_stats_t
+    {
+        std::atomic<int64_t> allocations = 0;
+        std::atomic<int64_t> live_bytes = 0;
+        std::atomic<int64_t> peak_bytes = 0;
+    };
+
+    heap_stats_t heap_stats;
+    constexpr size_t heap_header_size = 16;  // Keeps the returned pointer aligned
+
+    //---------------------------------------------------------------------------------------
+    void* tracked_alloc(size_t size)
+    {
+        char* ptr = (char*)malloc(size + heap_header_size);
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        memcpy(ptr, &size, sizeof(size));
+        ++heap_stats.allocations;
+        const int64_t live_bytes = heap_stats.live_bytes += size;
+        int64_t peak_bytes = heap_stats.peak_bytes;
+        while (live_bytes > peak_bytes && !heap_stats.peak_bytes.compare_exchange_weak(peak_bytes, live_bytes)) {
+        }
+        return ptr + heap_header_size;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void tracked_free(void* user_ptr)
+    {
+        if (!user_ptr) {
+            return;
+        }
+        char* ptr = (char*)user_ptr - heap_header_size;
+        size_t size;
+        memcpy(&size, ptr, sizeof(size));
+        heap_stats.live_bytes -= size;
+        free(ptr);
+    }
+}  // namespace
+
+void* operator new(size_t size)
+{
+    return tracked_alloc(size);
+}
+
+void* operator new[](size_t size)
+{
+    return tracked_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+    tracked_free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+    tracked_free(ptr);
+}
+
+//=======================================================================================
+// Small deterministic random generator, so every run builds the same trees
+struct rng_t
+{
+    uint32_t state = 0x12345678;
+
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    int range(int lo, int hi)
+    {
+        return lo + (int)(next() % (uint32_t)(hi - lo + 1));
+    }
+
+    float range(float lo, float hi)
+    {
+        return lo + (hi - lo) * (float)(next() & 0xffffff) / (float)0xffffff;
+    }
+};
+
+static const flexy::rect_t layout_rect = {0, 0, 1920, 1080};
+
+// The smallest subtree handed to the thread pool. Lower than the default, so the panels of wrapping_grid are split up
+static const int min_parallel_items = 256;
+
+// Keeps the render callbacks from being optimized away
+static int render_count = 0;
+
+//---------------------------------------------------------------------------------------
+static void render_item(void* userdata, const flexy::rect_t& rect)
+{
+    ++render_count;
+}
+
+//---------------------------------------------------------------------------------------
+// One long row, which overflows the container and has to shrink
+static void build_wide_row(flexy::layout_t& layout, int item_count)
+{
+    int row = layout.add_item({
+        .width = layout_rect.width,
+        .height = layout_rect.height,
+        .horizontal = true,
+    });
+
+    for (int i = 1; i < item_count; ++i) {
+        layout.add_item({
+            .parent_id = row,
+            .width = 40.f,
+            .height = 20.f,
+            .min_width = 0.001f,
+            .flex_shrink = 1,
+            .margin = flexy::margin_t{1, 1, 1, 1},
+            .render_callback = render_item,
+        });
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// Every item is the only child of the previous one
+static void build_deep_chain(flexy::layout_t& layout, int item_count)
+{
+    int parent = 0;
+    for (int i = 0; i < item_count; ++i) {
+        parent = layout.add_item({
+            .parent_id = parent,
+            .width = layout_rect.width,
+            .height = layout_rect.height,
+            .horizontal = (i & 1) == 0,
+            .container_alignment = flexy::container_alignment_t::center,
+            .item_alignment = flexy::item_alignment_t::stretch,
+            .render_callback = render_item,
+        });
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// Rows of cells that wrap inside fixed size panels
+static void build_wrapping_grid(flexy::layout_t& layout, int item_count)
+{
+    flexy::scoped_config_t panel_cfg(
+        {
+            .width = 480.f,
+            .height = 270.f,
+            .horizontal = true,
+            .wrap = true,
+            .multi_row_alignment = flexy::container_alignment_t::stretch,
+        },
+        &layout);
+
+    int grid = layout.add_item({
+        .width = layout_rect.width,
+        .height = layout_rect.height,
+        .wrap = true,
+    });
+
+    const int cells_per_panel = 256;
+    for (int added = 1; added < item_count;) {
+        int panel = layout.add_item({.parent_id = grid});
+        ++added;
+        for (int i = 0; i < cells_per_panel && added < item_count; ++i, ++added) {
+            layout.add_item({
+                .parent_id = panel,
+                .width = 28.f,
+                .height = 14.f,
+                .margin = flexy::margin_t{1, 1, 1, 1},
+                .wrap = false,
+                .multi_row_alignment = flexy::container_alignment_t::start,
+                .render_callback = render_item,
+            });
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// A random tree where items both grow and shrink, and the containers cycle through all the alignment modes
+static void build_mixed_flex(flexy::layout_t& layout, int item_count)
+{
+    rng_t rng;
+    std::vector<int> containers = {0};
+    int added = 0;
+    while (added < item_count) {
+        const int parent = containers[rng.next() % containers.size()];
+        const bool is_container = rng.range(0, 7) == 0;
+        const int id = layout.add_item({
+            .parent_id = parent,
+            .width = rng.range(10.f, 300.f),
+            .height = rng.range(10.f, 200.f),
+            .min_width = rng.range(0.f, 10.f),
+            .min_height = rng.range(0.f, 10.f),
+            .max_width = rng.range(200.f, 600.f),
+            .max_height = rng.range(200.f, 600.f),
+            .flex_grow = rng.range(0, 3),
+            .flex_shrink = rng.range(0, 3),
+            .margin = flexy::margin_t{2, 2, 2, 2},
+            .padding = flexy::padding_t{1, 1, 1, 1},
+            .horizontal = (added & 1) == 0,
+            .wrap = rng.range(0, 1) == 0,
+            .container_alignment = flexy::container_alignment_t(added % 6),
+            .multi_row_alignment = flexy::container_alignment_t(added % 7),
+            .item_alignment = flexy::item_alignment_t(added % 4),
+            .render_callback = render_item,
+        });
+        ++added;
+        if (is_container) {
+            containers.push_back(id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// The same tree as mixed_flex, but built with packed configs, to compare the cost of add_item
+static void build_mixed_flex_packed(flexy::layout_t& layout, int item_count)
+{
+    rng_t rng;
+    std::vector<int> containers = {0};
+    int added = 0;
+    while (added < item_count) {
+        const int parent = containers[rng.next() % containers.size()];
+        const bool is_container = rng.range(0, 7) == 0;
+        const int id = layout.add_item(flexy::cfg()
+                                           .parent_id(parent)
+                                           .width(rng.range(10.f, 300.f))
+                                           .height(rng.range(10.f, 200.f))
+                                           .min_width(rng.range(0.f, 10.f))
+                                           .min_height(rng.range(0.f, 10.f))
+                                           .max_width(rng.range(200.f, 600.f))
+                                           .max_height(rng.range(200.f, 600.f))
+                                           .flex_grow(rng.range(0, 3))
+                                           .flex_shrink(rng.range(0, 3))
+                                           .margin({2, 2, 2, 2})
+                                           .padding({1, 1, 1, 1})
+                                           .horizontal((added & 1) == 0)
+                                           .wrap(rng.range(0, 1) == 0)
+                                           .container_alignment(flexy::container_alignment_t(added % 6))
+                                           .multi_row_alignment(flexy::container_alignment_t(added % 7))
+                                           .item_alignment(flexy::item_alignment_t(added % 4))
+                                           .render_callback(render_item));
+        ++added;
+        if (is_container) {
+            containers.push_back(id);
+        }
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// A table with one row per item, each with its own height, added one at a time
+static void build_table_rows(flexy::layout_t& layout, int item_count)
+{
+    rng_t rng;
+    int table = layout.add_item({
+        .width = layout_rect.width,
+        .height = layout_rect.height,
+        .horizontal = false,
+        .item_alignment = flexy::item_alignment_t::stretch,
+    });
+
+    for (int i = 1; i < item_count; ++i) {
+        layout.add_item({
+            .parent_id = table,
+            .height = rng.range(16.f, 40.f),
+            .flex_shrink = 1,
+            .margin = flexy::margin_t{0, 0, 1, 0},
+            .render_callback = render_item,
+        });
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// The same table as table_rows, but with all the rows added in one call to add_items
+static void build_table_bulk(flexy::layout_t& layout, int item_count)
+{
+    rng_t rng;
+    int table = layout.add_item({
+        .width = layout_rect.width,
+        .height = layout_rect.height,
+        .horizontal = false,
+        .item_alignment = flexy::item_alignment_t::stretch,
+    });
+
+    std::vector<float> heights(item_count - 1);
+    for (float& height : heights) {
+        height = rng.range(16.f, 40.f);
+    }
+    layout.add_items(
+        table,
+        (int)heights.size(),
+        {
+            .flex_shrink = 1,
+            .margin = flexy::margin_t{0, 0, 1, 0},
+            .render_callback = render_item,
+        },
+        {},
+        heights);
+}
+
+//=======================================================================================
+struct tree_t
+{
+    const char* name;
+    void (*build)(flexy::layout_t& layout, int item_count);
+};
+
+static const tree_t trees[] = {
+    {"wide_row", build_wide_row},
+    {"deep_chain", build_deep_chain},
+    {"wrapping_grid", build_wrapping_grid},
+    {"mixed_flex", build_mixed_flex},
+    {"mixed_packed", build_mixed_flex_packed},
+    {"table_rows", build_table_rows},
+    {"table_bulk", build_table_bulk},
+};
+
+struct phase_result_t
+{
+    double ns_per_item = 0;
+    double allocations = 0;  // Per frame
+    int64_t peak_bytes = 0;  // Heap growth above what was live when the phase started
+};
+
+//---------------------------------------------------------------------------------------
+static void run(const tree_t& tree, int item_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+
+    // Run enough frames to get a stable result, but keep the large trees from taking forever
+    const int frame_count = std::clamp(2'000'000 / item_count, 3, 200);
+
+    std::vector<double> add_times;
+    std::vector<double> layout_times;
+    phase_result_t add;
+    phase_result_t layout;
+    flexy::layout_stats_t stats;
+
+    for (int frame = 0; frame < frame_count; ++frame) {
+        const int64_t start_allocations = heap_stats.allocations;
+        const int64_t start_bytes = heap_stats.live_bytes;
+        heap_stats.peak_bytes = heap_stats.live_bytes.load();
+        const steady_clock::time_point t0 = steady_clock::now();
+
+        flexy::layout_t* l = new flexy::layout_t(layout_rect);
+        tree.build(*l, item_count);
+
+        const steady_clock::time_point t1 = steady_clock::now();
+        const int64_t mid_allocations = heap_stats.allocations;
+        const int64_t mid_bytes = heap_stats.live_bytes;
+        add.allocations += double(mid_allocations - start_allocations);
+        add.peak_bytes = std::max(add.peak_bytes, heap_stats.peak_bytes.load() - start_bytes);
+        heap_stats.peak_bytes = heap_stats.live_bytes.load();
+
+        l->do_layout();
+
+        const steady_clock::time_point t2 = steady_clock::now();
+        layout.allocations += double(heap_stats.allocations - mid_allocations);
+        layout.peak_bytes = std::max(layout.peak_bytes, heap_stats.peak_bytes.load() - mid_bytes);
+
+        const flexy::layout_stats_t frame_stats = l->get_stats();
+        stats.row_split_ns += frame_stats.row_split_ns;
+        stats.flex_ns += frame_stats.flex_ns;
+        stats.main_axis_ns += frame_stats.main_axis_ns;
+        stats.cross_axis_ns += frame_stats.cross_axis_ns;
+        stats.rect_ns += frame_stats.rect_ns;
+        stats.render_callback_ns += frame_stats.render_callback_ns;
+        stats.items_drawn += frame_stats.items_drawn;
+        stats.items_culled += frame_stats.items_culled;
+        stats.containers_visited += frame_stats.containers_visited;
+        stats.rows_created += frame_stats.rows_created;
+        stats.items_wrapped += frame_stats.items_wrapped;
+        stats.scratch_growths += frame_stats.scratch_growths;
+
+        delete l;
+
+        add_times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+        layout_times.push_back(std::chrono::duration<double, std::nano>(t2 - t1).count());
+    }
+
+    // Report the median frame
+    std::sort(add_times.begin(), add_times.end());
+    std::sort(layout_times.begin(), layout_times.end());
+    add.ns_per_item = add_times[frame_count / 2] / item_count;
+    add.allocations /= frame_count;
+    layout.ns_per_item = layout_times[frame_count / 2] / item_count;
+    layout.allocations /= frame_count;
+
+    printf(
+        "%-14s %8d %7d | %9.1f %11.1f %10.1f | %9.1f %11.1f %10.1f\n",
+        tree.name,
+        item_count,
+        frame_count,
+        add.ns_per_item,
+        add.allocations,
+        add.peak_bytes / 1024.0,
+        layout.ns_per_item,
+        layout.allocations,
+        layout.peak_bytes / 1024.0);
+
+    // Only filled in when flexy_layout.cpp is built with FLEXY_STATS=1
+    if (stats.containers_visited > 0) {
+        const double items = double(item_count) * frame_count;
+        printf(
+            "    ns/item: split %.1f, flex %.1f, main %.1f, cross %.1f, rects %.1f, callbacks %.1f\n"
+            "    per frame: %lld containers, %lld rows, %lld wrapped, %lld scratch growths, %lld drawn, %lld culled\n",
+            stats.row_split_ns / items,
+            stats.flex_ns / items,
+            stats.main_axis_ns / items,
+            stats.cross_axis_ns / items,
+            stats.rect_ns / items,
+            stats.render_callback_ns / items,
+            (long long)(stats.containers_visited / frame_count),
+            (long long)(stats.rows_created / frame_count),
+            (long long)(stats.items_wrapped / frame_count),
+            (long long)(stats.scratch_growths / frame_count),
+            (long long)(stats.items_drawn / frame_count),
+            (long long)(stats.items_culled / frame_count));
+    }
+    fflush(stdout);
+}
+
+//---------------------------------------------------------------------------------------
+// Counts the heap allocations per item caused by a render callback with 32 bytes of captures, which is too large
+// for std::function to store inline. render_callback_t stores it inline, so creating, moving and copying the
+// callback should never allocate.
+static void run_callback_copies(int item_count)
+{
+    struct capture_t
+    {
+        double values[4] = {1, 2, 3, 4};
+    };
+
+    auto count_allocations = [item_count](int mode) {
+        flexy::layout_t layout(layout_rect);
+        const int64_t start_allocations = heap_stats.allocations;
+        if (mode == 0) {
+            // No callback, to measure the allocations made by the layout itself
+            for (int i = 0; i < item_count; ++i) {
+                layout.add_item({.width = 10.f, .height = 10.f});
+            }
+        } else if (mode == 1) {
+            for (int i = 0; i < item_count; ++i) {
+                capture_t capture;
+                layout.add_item({
+                    .width = 10.f,
+                    .height = 10.f,
+                    .render_callback = [capture](void* userdata, const flexy::rect_t& rect) {
+                        render_count += (int)capture.values[0];
+                    },
+                });
+            }
+        } else {
+            capture_t capture;
+            const flexy::add_item_cfg_t cfg = {
+                .width = 10.f,
+                .height = 10.f,
+                .render_callback = [capture](void* userdata, const flexy::rect_t& rect) {
+                    render_count += (int)capture.values[0];
+                },
+            };
+            for (int i = 0; i < item_count; ++i) {
+                layout.add_item(cfg);
+            }
+        }
+        return heap_stats.allocations - start_allocations;
+    };
+
+    const int64_t layout_allocations = count_allocations(0);
+    printf(
+        "\nrender_callback heap allocations per item (%d items): %.2f with a temporary config, %.2f with a reused "
+        "config\n",
+        item_count,
+        double(count_allocations(1) - layout_allocations) / item_count,
+        double(count_allocations(2) - layout_allocations) / item_count);
+}
+
+//---------------------------------------------------------------------------------------
+// Writes to a buffer larger than the last level cache, to evict everything else from it
+static void flush_caches()
+{
+    static std::vector<char> buffer(64 << 20);
+    for (size_t i = 0; i < buffer.size(); i += 64) {
+        ++buffer[i];
+    }
+}
+
+//---------------------------------------------------------------------------------------
+// Times compute_layout for rows of 100 flex items that wrap, with and without a render callback and userdata on every
+// item, to show that the cold data isn't pulled into the cache by the layout loops
+static void run_hot_cold(int item_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int frame_count = 20;
+    const int items_per_row = 100;
+    const int row_count = std::max(item_count / items_per_row, 1);
+    double ns_per_item[2];
+
+    struct capture_t
+    {
+        double values[4] = {1, 2, 3, 4};
+    };
+
+    for (int cold = 0; cold < 2; ++cold) {
+        flexy::layout_t layout(layout_rect);
+        std::vector<double> times;
+        for (int frame = 0; frame < frame_count + 1; ++frame) {
+            layout.reset(layout_rect);
+            int column = layout.add_item({.width = layout_rect.width, .horizontal = false});
+            for (int row = 0; row < row_count; ++row) {
+                int row_id = layout.add_item({.parent_id = column, .width = layout_rect.width, .wrap = true});
+                for (int i = 0; i < items_per_row; ++i) {
+                    flexy::add_item_cfg_t cfg = {
+                        .parent_id = row_id,
+                        .width = 40.f + (float)(i % 7) * 4.f,
+                        .height = 20.f,
+                        .min_width = 30.f,
+                        .flex_grow = i % 3,
+                        .flex_shrink = 1,
+                    };
+                    if (cold) {
+                        capture_t capture;
+                        cfg.userdata = &layout;
+                        cfg.render_callback = [capture](void* userdata, const flexy::rect_t& rect) {
+                            render_count += (int)capture.values[0];
+                        };
+                    }
+                    layout.add_item(std::move(cfg));
+                }
+            }
+
+            // Building the tree writes the callbacks, which would evict some of the configs, so both runs start
+            // from an empty cache
+            flush_caches();
+            const steady_clock::time_point t0 = steady_clock::now();
+            layout.compute_layout();
+            const steady_clock::time_point t1 = steady_clock::now();
+
+            // The first frame grows the storage
+            if (frame > 0) {
+                times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count());
+            }
+        }
+        std::sort(times.begin(), times.end());
+        ns_per_item[cold] = times[times.size() / 2] / (row_count * (items_per_row + 1));
+    }
+
+    printf(
+        "hot/cold (%d rows of %d flex items): compute_layout %.1f ns/item, %.1f ns/item with a render callback and "
+        "userdata on every item\n",
+        row_count,
+        items_per_row,
+        ns_per_item[0],
+        ns_per_item[1]);
+}
+
+//---------------------------------------------------------------------------------------
+// Compares building a new layout every frame with resetting the same one, which keeps the storage from the
+// previous frame. The counts include the allocations made by the tree builders themselves
+static void run_reset(const tree_t& tree, int item_count)
+{
+    const int frame_count = 20;
+    int64_t new_allocations = 0;
+    int64_t reset_allocations = 0;
+
+    for (int frame = 0; frame < frame_count; ++frame) {
+        const int64_t start_allocations = heap_stats.allocations;
+        flexy::layout_t layout(layout_rect);
+        tree.build(layout, item_count);
+        layout.do_layout();
+        new_allocations += heap_stats.allocations - start_allocations;
+    }
+
+    flexy::layout_t layout(layout_rect);
+    for (int frame = 0; frame < frame_count + 1; ++frame) {
+        const int64_t start_allocations = heap_stats.allocations;
+        layout.reset(layout_rect);
+        tree.build(layout, item_count);
+        layout.do_layout();
+
+        // The first frame is where the storage is allocated
+        if (frame > 0) {
+            reset_allocations += heap_stats.allocations - start_allocations;
+        }
+    }
+
+    const flexy::layout_capacity_t capacity = layout.get_capacity();
+    printf(
+        "%s (%d items): %.1f allocs/frame with a new layout, %.1f with reset, %.1f KiB retained\n",
+        tree.name,
+        item_count,
+        double(new_allocations) / frame_count,
+        double(reset_allocations) / frame_count,
+        double(capacity.total_bytes) / 1024);
+}
+
+//---------------------------------------------------------------------------------------
+// Times compute_layout for a tree that's rebuilt every frame without changing, with and without the layout cache
+static void run_layout_cache(const tree_t& tree, int item_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int frame_count = 20;
+    double ns_per_item[2];
+
+    for (int cache = 0; cache < 2; ++cache) {
+        flexy::layout_t layout(layout_rect);
+        layout.set_layout_cache(cache != 0);
+        std::vector<double> times;
+        for (int frame = 0; frame < frame_count + 1; ++frame) {
+            layout.reset(layout_rect);
+            tree.build(layout, item_count);
+            const steady_clock::time_point t0 = steady_clock::now();
+            layout.compute_layout();
+            const steady_clock::time_point t1 = steady_clock::now();
+
+            // The first frame has nothing to reuse
+            if (frame > 0) {
+                times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / item_count);
+            }
+        }
+        std::sort(times.begin(), times.end());
+        ns_per_item[cache] = times[times.size() / 2];
+    }
+
+    printf(
+        "%s (%d items): compute_layout %.1f ns/item, %.1f ns/item with the layout cache\n",
+        tree.name,
+        item_count,
+        ns_per_item[0],
+        ns_per_item[1]);
+}
+
+//---------------------------------------------------------------------------------------
+// Times compute_layout for a tree that's rebuilt every frame, on the calling thread and on `pool`. Only subtrees with
+// at least min_parallel_items items are handed to the pool, so a tree made of one large container, like wide_row,
+// isn't split up at all
+static void run_thread_pool(const tree_t& tree, int item_count, flexy::thread_pool_t& pool)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int frame_count = 20;
+    double ns_per_item[2];
+
+    for (int pooled = 0; pooled < 2; ++pooled) {
+        flexy::layout_t layout(layout_rect);
+        layout.set_thread_pool(pooled ? &pool : nullptr, min_parallel_items);
+        std::vector<double> times;
+        for (int frame = 0; frame < frame_count + 1; ++frame) {
+            layout.reset(layout_rect);
+            tree.build(layout, item_count);
+            const steady_clock::time_point t0 = steady_clock::now();
+            layout.compute_layout();
+            const steady_clock::time_point t1 = steady_clock::now();
+
+            // The first frame grows the storage
+            if (frame > 0) {
+                times.push_back(std::chrono::duration<double, std::nano>(t1 - t0).count() / item_count);
+            }
+        }
+        std::sort(times.begin(), times.end());
+        ns_per_item[pooled] = times[times.size() / 2];
+    }
+
+    printf(
+        "%s (%d items): compute_layout %.1f ns/item, %.1f ns/item on %d workers (%.2fx)\n",
+        tree.name,
+        item_count,
+        ns_per_item[0],
+        ns_per_item[1],
+        pool.worker_count(),
+        ns_per_item[0] / ns_per_item[1]);
+}
+
+//---------------------------------------------------------------------------------------
+// Times do_layout for a virtual list with `row_count` rows, that's rebuilt every frame and scrolled by one screen,
+// with a fixed row size and with a row size callback. Only the visible rows should be laid out and rendered, so the
+// time per frame shouldn't depend on the number of rows. With the callback, each new screen of rows is measured once
+static void run_virtual_list(int row_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int frame_count = 100;
+    double us_per_frame[2];
+    const int start_render_count = render_count;
+
+    for (int callback = 0; callback < 2; ++callback) {
+        flexy::layout_t layout(layout_rect);
+        layout.set_layout_cache(true);
+        flexy::virtual_list_cfg_t list = {
+            .count = row_count,
+            .row_size = 20.f,
+            .render_row = [](void*, int, const flexy::rect_t&) { ++render_count; },
+        };
+        if (callback) {
+            list.row_size_callback = [](void*, int row) { return 16.f + (float)(row % 8); };
+        }
+
+        std::vector<double> times;
+        for (int frame = 0; frame < frame_count; ++frame) {
+            layout.reset(layout_rect);
+            layout.add_virtual_list(flexy::cfg().width(layout_rect.width).height(layout_rect.height), list);
+            const steady_clock::time_point t0 = steady_clock::now();
+            layout.do_layout();
+            const steady_clock::time_point t1 = steady_clock::now();
+            times.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+            list.scroll += layout_rect.height;
+        }
+        std::sort(times.begin(), times.end());
+        us_per_frame[callback] = times[times.size() / 2];
+    }
+
+    printf(
+        "virtual_list (%d rows): do_layout %.2f us/frame, %.2f us/frame with a row size callback, %d rows drawn\n",
+        row_count,
+        us_per_frame[0],
+        us_per_frame[1],
+        (render_count - start_render_count) / (2 * frame_count));
+}
+
+//---------------------------------------------------------------------------------------
+// Times scrolling a clipped panel of `item_count` rows, which only changes the scroll offset, so it should only cost
+// a render of the visible rows
+static void run_scroll(int item_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int frame_count = 100;
+
+    flexy::layout_t layout(layout_rect);
+    const flexy::id panel = layout.add_item(flexy::cfg().width(600.f).height(800.f).horizontal(false).clip(true));
+    layout.add_items(panel, item_count, flexy::cfg().height(24.f).flex_grow(1).render_callback(render_item));
+    layout.do_layout();
+
+    std::vector<double> times;
+    for (int frame = 0; frame < frame_count; ++frame) {
+        const steady_clock::time_point t0 = steady_clock::now();
+        layout.update_item(panel, flexy::cfg().scroll_y(frame * 24.f * item_count / frame_count));
+        layout.do_layout();
+        const steady_clock::time_point t1 = steady_clock::now();
+        times.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+    }
+    std::sort(times.begin(), times.end());
+
+    printf("scroll (%d items): %.2f us/frame\n", item_count, times[times.size() / 2]);
+}
+
+//---------------------------------------------------------------------------------------
+// Times `item_at` and `items_intersecting` at points spread over the layout rect. The first query after the layout
+// computes the bounds of the whole tree, so it's timed on its own
+static void run_hit_test(const tree_t& tree, int item_count)
+{
+    using steady_clock = std::chrono::steady_clock;
+    const int query_count = 1000;
+
+    flexy::layout_t layout(layout_rect);
+    tree.build(layout, item_count);
+    layout.compute_layout();
+
+    // Fixed points, so every run queries the same ones
+    auto point = [](int i, float& x, float& y) {
+        x = (float)(i * 7919 % (int)layout_rect.width) + 0.5f;
+        y = (float)(i * 104729 % (int)layout_rect.height) + 0.5f;
+    };
+
+    float x, y;
+    point(0, x, y);
+    steady_clock::time_point t0 = steady_clock::now();
+    int hits = layout.item_at(x, y) >= 0 ? 1 : 0;
+    steady_clock::time_point t1 = steady_clock::now();
+    const double first_us = std::chrono::duration<double, std::micro>(t1 - t0).count();
+
+    t0 = steady_clock::now();
+    for (int i = 1; i < query_count; ++i) {
+        point(i, x, y);
+        hits += layout.item_at(x, y) >= 0 ? 1 : 0;
+    }
+    t1 = steady_clock::now();
+    const double item_at_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / (query_count - 1);
+
+    std::vector<flexy::id> items;
+    size_t intersecting = 0;
+    t0 = steady_clock::now();
+    for (int i = 0; i < query_count; ++i) {
+        point(i, x, y);
+        layout.items_intersecting(flexy::rect_t{x, y, 64.f, 64.f}, items);
+        intersecting += items.size();
+    }
+    t1 = steady_clock::now();
+    const double intersecting_ns = std::chrono::duration<double, std::nano>(t1 - t0).count() / query_count;
+
+    printf(
+        "%s (%d items): first query %.1f us, item_at %.1f ns (%d%% hit), items_intersecting 64x64 %.1f ns "
+        "(%.1f items)\n",
+        tree.name,
+        item_count,
+        first_us,
+        item_at_ns,
+        hits * 100 / query_count,
+        intersecting_ns,
+        (double)intersecting / query_count);
+}
+
+//---------------------------------------------------------------------------------------
+// Returns the number of heap allocations made by `frame_count` calls to do_layout on a tree rebuilt every frame, after
+// a first frame that grows the storage. The tree builders may allocate, so only do_layout is counted
+static int64_t count_layout_allocations(
+    const tree_t& tree,
+    int item_count,
+    flexy::traversal_order_t order,
+    flexy::thread_pool_t* pool)
+{
+    const int frame_count = 5;
+    int64_t allocations = 0;
+
+    flexy::layout_t layout(layout_rect);
+    layout.set_traversal_order(order);
+    layout.set_thread_pool(pool, min_parallel_items);
+    for (int frame = 0; frame < frame_count + 1; ++frame) {
+        layout.reset(layout_rect);
+        tree.build(layout, item_count);
+        const int64_t start_allocations = heap_stats.allocations;
+        layout.do_layout();
+        if (frame > 0) {
+            allocations += heap_stats.allocations - start_allocations;
+        }
+    }
+    return allocations;
+}
+
+//---------------------------------------------------------------------------------------
+static int check_allocations(int item_count)
+{
+    static const struct
+    {
+        const char* name;
+        flexy::traversal_order_t order;
+    } orders[] = {
+        {"depth_first", flexy::traversal_order_t::depth_first},
+        {"breadth_first", flexy::traversal_order_t::breadth_first},
+    };
+
+    // A fixed number of workers, so the tasks are handed between threads even on a single core
+    flexy::thread_pool_t pool(4);
+    flexy::thread_pool_t* pools[] = {nullptr, &pool};
+
+    int failures = 0;
+    for (const tree_t& tree : trees) {
+        for (const auto& order : orders) {
+            for (flexy::thread_pool_t* p : pools) {
+                const int64_t allocations = count_layout_allocations(tree, item_count, order.order, p);
+                printf(
+                    "%-14s %-13s %-9s (%d items): %lld allocations in do_layout\n",
+                    tree.name,
+                    order.name,
+                    p ? "pool" : "no pool",
+                    item_count,
+                    (long long)allocations);
+                failures += allocations > 0 ? 1 : 0;
+            }
+        }
+    }
+    printf(failures ? "FAILED: %d runs allocated\n" : "OK\n", failures);
+    return failures > 0 ? 1 : 0;
+}
+
+//---------------------------------------------------------------------------------------
+// Scrolls a clipping panel until the parent of an item is out of view, while the item overflows the parent into
+// view. Either with a single row of children scrolled along it, or with rows that wrap, scrolled across them. The
+// item is the only thing at (x, y). Returns the number of failed checks
+static int check_overflow(bool wrap)
+{
+    const float x = wrap ? 270.f : 50.f;
+    const float y = 45.f;
+    int drawn = 0;
+    int hits = 0;
+
+    flexy::layout_t layout(layout_rect);
+    flexy::packed_cfg_t panel_cfg = flexy::cfg().width(300.f).height(100.f).horizontal(true).clip(true);
+    if (wrap) {
+        panel_cfg.wrap(true).scroll_y(60.f);
+    } else {
+        panel_cfg.scroll_x(400.f);
+    }
+    const flexy::id panel = layout.add_item(panel_cfg);
+
+    // Without wrapping, child 3 ends up at -100..0 along the row. With wrapping, there are 3 children in each row,
+    // so child 5 ends up at 160..240, -30..0
+    const int parent_index = wrap ? 5 : 3;
+    flexy::id item = -1;
+    for (int i = 0; i < 12; ++i) {
+        const flexy::id child =
+            layout.add_item(flexy::cfg().parent_id(panel).width(wrap ? 80.f : 100.f).height(30.f).flex_shrink(0));
+        if (i == parent_index) {
+            item = layout.add_item(flexy::cfg()
+                                       .parent_id(child)
+                                       .width(wrap ? 120.f : 250.f)
+                                       .height(wrap ? 90.f : 60.f)
+                                       .flex_shrink(0)
+                                       .render_callback([&drawn](void*, const flexy::rect_t&) { ++drawn; }));
+        }
+    }
+    layout.do_layout();
+
+    std::vector<flexy::id> items;
+    layout.items_intersecting(flexy::rect_t{x, y, 1.f, 1.f}, items);
+    hits += layout.item_at(x, y) == item ? 1 : 0;
+    hits += std::find(items.begin(), items.end(), item) != items.end() ? 1 : 0;
+
+    printf("overflow %s: drawn %d time(s), hit %d/2\n", wrap ? "across wrapped rows" : "along a row", drawn, hits);
+    return (drawn == 1 ? 0 : 1) + (hits == 2 ? 0 : 1);
+}
+
+//---------------------------------------------------------------------------------------
+static int check_render()
+{
+    const int failures = check_overflow(false) + check_overflow(true);
+    printf(failures ? "FAILED: %d checks\n" : "OK\n", failures);
+    return failures > 0 ? 1 : 0;
+}
+
+//---------------------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+    if (argc > 1 && strcmp(argv[1], "--check-allocs") == 0) {
+        return check_allocations(argc > 2 ? atoi(argv[2]) : 100'000);
+    }
+    if (argc > 1 && strcmp(argv[1], "--check-render") == 0) {
+        return check_render();
+    }
+
+    const int max_items = argc > 1 ? atoi(argv[1]) : 1'000'000;
+    const char* only_tree = argc > 2 ? argv[2] : nullptr;
+
+    printf("%-14s %8s %7s | %-32s | %-32s\n", "", "", "", "add_item", "do_layout");
+    printf(
+        "%-14s %8s %7s | %9s %11s %10s | %9s %11s %10s\n",
+        "tree",
+        "items",
+        "frames",
+        "ns/item",
+        "allocs/frm",
+        "peak KiB",
+        "ns/item",
+        "allocs/frm",
+        "peak KiB");
+
+    for (const tree_t& tree : trees) {
+        if (only_tree && strcmp(only_tree, tree.name) != 0) {
+            continue;
+        }
+        for (int item_count = 1000; item_count <= max_items; item_count *= 10) {
+            run(tree, item_count);
+        }
+    }
+
+    run_callback_copies(std::min(max_items, 100'000));
+    run_hot_cold(std::min(max_items, 100'000));
+
+    printf("\n");
+    for (const tree_t& tree : trees) {
+        if (only_tree && strcmp(only_tree, tree.name) != 0) {
+            continue;
+        }
+        run_reset(tree, std::min(max_items, 100'000));
+    }
+
+    printf("\n");
+    for (const tree_t& tree : trees) {
+        if (only_tree && strcmp(only_tree, tree.name) != 0) {
+            continue;
+        }
+        run_layout_cache(tree, std::min(max_items, 100'000));
+    }
+
+    printf("\n");
+    flexy::thread_pool_t pool;
+    for (const tree_t& tree : trees) {
+        if (only_tree && strcmp(only_tree, tree.name) != 0) {
+            continue;
+        }
+        run_thread_pool(tree, std::min(max_items, 100'000), pool);
+    }
+
+    printf("\n");
+    run_virtual_list(max_items);
+    run_scroll(std::min(max_items, 100'000));
+
+    printf("\n");
+    for (const tree_t& tree : trees) {
+        if (only_tree && strcmp(only_tree, tree.name) != 0) {
+            continue;
+        }
+        run_hit_test(tree, std::min(max_items, 100'000));
+    }
+
+    return render_count > 0 ? 0 : 1;
+}
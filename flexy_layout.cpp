@@ -1,7 +1,30 @@
 #include "flexy_layout.hpp"
+#include "flexy_simd.hpp"
+#include "flexy_thread_pool.hpp"
 
 #include <assert.h>
-#include <raylib.h>  // For Rectangle and scissoring
+#include <float.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <span>
+
+// Set to 1 to collect the numbers returned by `layout_t::get_stats`
+#ifndef FLEXY_STATS
+#define FLEXY_STATS 0
+#endif
+
+#if FLEXY_STATS
+#define FLEXY_STATS_ADD(stats, field, value) (stats).field += (value)
+#define FLEXY_STATS_LAP_START(lap) std::chrono::steady_clock::time_point lap = std::chrono::steady_clock::now()
+#define FLEXY_STATS_LAP(lap, stats, field) (stats).field += lap_ns(lap)
+#else
+#define FLEXY_STATS_ADD(stats, field, value)
+#define FLEXY_STATS_LAP_START(lap)
+#define FLEXY_STATS_LAP(lap, stats, field)
+#endif
 
 namespace flexy {
 
@@ -26,10 +49,49 @@ namespace flexy {
         return v < lo ? lo : v > hi ? hi : v;
     }
 
+#if FLEXY_STATS
+    //---------------------------------------------------------------------------------------
+    // Returns the time since `lap`, and moves `lap` to now
+    inline int64_t lap_ns(std::chrono::steady_clock::time_point& lap)
+    {
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(now - lap).count();
+        lap = now;
+        return ns;
+    }
+#endif
+
+    //---------------------------------------------------------------------------------------
+    inline int64_t trace_clock_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Resize and push_back for the scratch buffers, that count the times the buffer has to grow
+    template <typename T>
+    void scratch_resize(std::vector<T>& buffer, size_t size, [[maybe_unused]] layout_stats_t& stats)
+    {
+        FLEXY_STATS_ADD(stats, scratch_growths, size > buffer.capacity() ? 1 : 0);
+        buffer.resize(size);
+    }
+
+    //---------------------------------------------------------------------------------------
+    template <typename T>
+    void scratch_push(std::vector<T>& buffer, const T& value, [[maybe_unused]] layout_stats_t& stats)
+    {
+        FLEXY_STATS_ADD(stats, scratch_growths, buffer.size() == buffer.capacity() ? 1 : 0);
+        buffer.push_back(value);
+    }
+
     //=======================================================================================
+    // The data for each item is split up depending on when it's used. item_cfg_t is read for every child of a
+    // container being laid out, item_node_t is used when walking the tree, and item_cold_t is only needed when
+    // rendering.
     struct item_cfg_t
     {
-        void* userdata = nullptr;
         int parent_id = 0;
 
         float width = 0;
@@ -52,519 +114,2156 @@ namespace flexy {
         container_alignment_t container_alignment = container_alignment_t::start;
         container_alignment_t multi_row_alignment = container_alignment_t::start;
         item_alignment_t item_alignment = item_alignment_t::start;
+    };
+
+    //---------------------------------------------------------------------------------------
+    // The bounds kept for every subtree, see `update_bounds`
+    enum bounds_kind_t : uint8_t {
+        hit_bounds = 1u << 0,   // Cover the items that can be hit, ie the ones with an area
+        draw_bounds = 1u << 1,  // Cover the items that can be drawn, including the ones with a zero or negative size
+        all_bounds = hit_bounds | draw_bounds,
+    };
+
+    //---------------------------------------------------------------------------------------
+    constexpr int invalid_id = -1;
+
+    struct item_node_t
+    {
+        // Adding an item only links it to its parent. The children of each item are stored as a contiguous range
+        // in `child_index_`, which is rebuilt in one go before the tree is traversed
+        int parent = invalid_id;
+        int child_count = 0;
+        int child_start = 0;
+        int subtree_size = 1;  // The number of items in the subtree, including the item itself
+
+        bool dirty = true;          // The children of this item need to be laid out again
+        bool subtree_dirty = true;  // This item, or some item below it, is dirty
+
+        // The bounds of this item, or of some item below it, have to be recomputed. One bit for each bounds_kind_t
+        uint8_t bounds_dirty = all_bounds;
+    };
 
+    //---------------------------------------------------------------------------------------
+    struct item_cold_t
+    {
+        void* userdata = nullptr;
         render_callback_t render_callback;
+        bool clip = false;
+        int virtual_list = invalid_id;  // The index in `lists_`, if the item is a virtual list
+        float scroll_x = 0;
+        float scroll_y = 0;
     };
 
     //---------------------------------------------------------------------------------------
-    struct item_t
+    struct virtual_list_t
     {
-        item_t(const item_cfg_t cfg, int id) : cfg(cfg), id(id)
-        {
-        }
+        int item_id = invalid_id;
+        virtual_list_cfg_t cfg;
 
-        int id = -1;
-        item_cfg_t cfg;
+        // With a row_size_callback, the start of each row that has been measured so far, followed by the end of
+        // the last one. Rows are always measured in order
+        std::vector<double> row_starts;
 
-        Rectangle computed_rect;  // The usable area after layout has been performed
-        std::vector<item_t*> children;
+        virtual_range_t range;  // The rows materialized by the last compute_layout
     };
 
-    //=======================================================================================
-    struct layout_t::private_t
+    //---------------------------------------------------------------------------------------
+    // The clip rect, and the scroll offset, that apply to the items being rendered
+    struct render_state_t
     {
-        private_t(const Rectangle& layout_rect);
-        ~private_t();
+        rect_t clip;
+        float offset_x = 0;
+        float offset_y = 0;
+    };
 
-        void push_config(const add_item_cfg_t& cfg);
-        void pop_config();
+    //---------------------------------------------------------------------------------------
+    // An item left to visit by the hit tests
+    struct hit_entry_t
+    {
+        render_state_t state;  // The state the item is rendered with
+        int item_id = invalid_id;
+        bool children_done = false;  // The children have been tested, so only the item itself is left
+    };
 
-        id add_item(const add_item_cfg_t& cfg);
-        void do_layout();
-        Rectangle get_rect_for_item(id item_id) const;
-    
+    //---------------------------------------------------------------------------------------
+    // For a child, how far the bounds of it and the siblings before it reach, and where the bounds of it and the
+    // siblings after it start. Both only grow from one child to the next, whatever order the children are laid out
+    // in, so the children near a point can be found with a binary search
+    struct sibling_extent_t
+    {
+        float end_x = -FLT_MAX;
+        float end_y = -FLT_MAX;
+        float start_x = FLT_MAX;
+        float start_y = FLT_MAX;
+    };
 
-        std::vector<float> layout1d(
-            container_alignment_t alignment,
-            float start,
-            float end,
-            const std::vector<float>& items);
+    // The bounds of a subtree that has nothing to draw or hit, see `update_bounds`
+    constexpr rect_t no_bounds = {0, 0, -1, -1};
 
-        void layout_container(float start_x, float start_y, const item_t* parent);
+    //---------------------------------------------------------------------------------------
+    // The fields that are stored in item_cold_t, and don't affect the layout
+    constexpr uint32_t cold_fields =
+        field_userdata | field_render_callback | field_clip | field_scroll_x | field_scroll_y;
 
-        id next_item_id_ = 1;
-        std::vector<item_t*> items_;
-        Rectangle layout_rect_;
-        std::vector<add_item_cfg_t> config_stack_;
-    };
+    //---------------------------------------------------------------------------------------
+    // The stable key of the root item, that the keys of all the other items are derived from
+    constexpr uint64_t root_key = 0x9e3779b97f4a7c15ull;
 
-    //=======================================================================================
-    layout_t::private_t::private_t(const Rectangle& layout_rect) : layout_rect_(layout_rect)
+    //---------------------------------------------------------------------------------------
+    // splitmix64
+    inline uint64_t mix_key(uint64_t x)
     {
-        items_.push_back(new item_t({.width = layout_rect.width, .height = layout_rect.height}, 0));
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        x ^= x >> 31;
+        return x;
     }
 
     //---------------------------------------------------------------------------------------
-    layout_t::private_t::~private_t()
+    // Combines the key of the parent with the key of the child, or with the child's position among its siblings if
+    // it doesn't have one, so keys only have to be unique among siblings
+    inline uint64_t child_key(uint64_t parent_key, const packed_cfg_t& cfg, int sibling_index)
     {
-        for (item_t* item : items_) {
-            delete item;
-        }
-        items_.clear();
+        const uint64_t local_key = (cfg.fields & field_key) ? mix_key(cfg.values.key ^ 0x632be59bd9b4e019ull)
+                                                            : mix_key((uint64_t)sibling_index);
+        return mix_key(parent_key ^ local_key);
     }
 
     //---------------------------------------------------------------------------------------
-    void layout_t::private_t::push_config(const add_item_cfg_t& cfg)
+    // Compares everything that affects how an item is laid out in its parent, and how its children are laid out,
+    // which is every field after parent_id. They're compared bitwise, as the cached results are only valid if the
+    // inputs are bit-identical
+    inline bool same_layout(const item_cfg_t& a, const item_cfg_t& b)
     {
-        // Macro that either uses the value on the config stack, or uses the supplied value, depending on if
-        // `cfg.merge_config` is set or not
-#define MERGE(x)                                                                                                     \
-    if (cfg.merge_config && !config_stack_.empty() && config_stack_.back().x.has_value() && !merged.x.has_value()) { \
-        merged.x = config_stack_.back().x;                                                                           \
-    }
-        add_item_cfg_t merged = cfg;
-        MERGE(userdata);
-        MERGE(parent_id);
-        MERGE(width);
-        MERGE(height);
-        MERGE(min_width);
-        MERGE(min_height);
-        MERGE(max_width);
-        MERGE(max_height);
-        MERGE(flex_grow);
-        MERGE(flex_shrink);
-        MERGE(margin);
-        MERGE(padding);
-        MERGE(horizontal);
-        MERGE(wrap);
-        MERGE(container_alignment);
-        MERGE(multi_row_alignment);
-        MERGE(item_alignment);
-        MERGE(render_callback);
-        config_stack_.push_back(merged);
-#undef MERGE
+        constexpr size_t start = offsetof(item_cfg_t, width);
+        constexpr size_t end = offsetof(item_cfg_t, item_alignment) + sizeof(item_alignment_t);
+        static_assert(
+            end - start
+                == 6 * sizeof(float) + 2 * sizeof(int) + sizeof(margin_t) + sizeof(padding_t) + 2 * sizeof(bool)
+                       + 2 * sizeof(container_alignment_t) + sizeof(item_alignment_t),
+            "item_cfg_t has padding between its fields");
+        return memcmp((const char*)&a + start, (const char*)&b + start, end - start) == 0;
     }
 
     //---------------------------------------------------------------------------------------
-    void layout_t::private_t::pop_config()
+    // True if the rects share some area. Rects with no area never overlap anything
+    inline bool overlaps(const rect_t& a, const rect_t& b)
     {
-        config_stack_.pop_back();
+        return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height;
     }
 
     //---------------------------------------------------------------------------------------
-    id layout_t::private_t::add_item(const add_item_cfg_t& cfg)
+    inline rect_t intersect(const rect_t& a, const rect_t& b)
     {
-        item_cfg_t local_cfg;
-
-        // Macro the either used the supplied value from config, or uses the value on the config stack.
-#define MERGE(x)                                                                                                      \
-    if (!cfg.x.has_value() && cfg.use_config_stack && !config_stack_.empty() && config_stack_.back().x.has_value()) { \
-        local_cfg.x = config_stack_.back().x.value();                                                                 \
-    } else if (cfg.x.has_value()) {                                                                                   \
-        local_cfg.x = cfg.x.value();                                                                                  \
-    }
-
-        MERGE(userdata);
-        MERGE(parent_id);
-        MERGE(width);
-        MERGE(height);
-        MERGE(min_width);
-        MERGE(min_height);
-        MERGE(max_width);
-        MERGE(max_height);
-        MERGE(flex_grow);
-        MERGE(flex_shrink);
-        MERGE(margin);
-        MERGE(padding);
-        MERGE(horizontal);
-        MERGE(wrap);
-        MERGE(container_alignment);
-        MERGE(multi_row_alignment);
-        MERGE(item_alignment);
-        MERGE(render_callback);
-
-#undef MERGE
-
-        // Initialize the item
-        item_t* item = new item_t(local_cfg, next_item_id_++);
-        items_.push_back(item);
-
-        // Add the item to its parent (the default is the root container)
-        assert(local_cfg.parent_id >= 0);
-        assert(local_cfg.parent_id < items_.size());
-        items_[local_cfg.parent_id]->children.push_back(item);
-
-        return item->id;
+        const float x0 = flexy_max(a.x, b.x);
+        const float y0 = flexy_max(a.y, b.y);
+        const float x1 = flexy_min(a.x + a.width, b.x + b.width);
+        const float y1 = flexy_min(a.y + a.height, b.y + b.height);
+        return rect_t{x0, y0, flexy_max(x1 - x0, 0.f), flexy_max(y1 - y0, 0.f)};
     }
 
     //---------------------------------------------------------------------------------------
-    std::vector<float> layout_t::private_t::layout1d(
-        container_alignment_t alignment,
-        float start,
-        float end,
-        const std::vector<float>& items)
+    inline bool contains(const rect_t& rect, float x, float y)
     {
-        assert(alignment >= container_alignment_t::start);
-        assert(alignment <= container_alignment_t::space_evenly);
-
-        float total_item_size = 0;
-        for (float sz : items) {
-            total_item_size += sz;
-        }
-
-        const float total_layout_size = end - start;
-        const float free_space = total_layout_size - total_item_size;
-        assert(total_layout_size >= total_item_size);
-
-        const size_t item_count = items.size();
-        std::vector<float> positions(item_count);
-
-        switch (alignment) {
-                // see https://developer.mozilla.org/en-US/docs/Web/CSS/justify-content
-            case container_alignment_t::start:
-            case container_alignment_t::end:
-            case container_alignment_t::center: {
-                float pos;
-                if (alignment == container_alignment_t::start) {
-                    pos = 0;
-                } else if (alignment == container_alignment_t::end) {
-                    pos = start + free_space;
-                } else {
-                    // center
-                    pos = start + free_space / 2;
-                }
-                for (int i = 0; i < item_count; ++i) {
-                    positions[i] = pos;
-                    pos += items[i];
-                }
-                break;
-            }
-            case container_alignment_t::space_between: {
-                //  The items are evenly distributed within the alignment container along the main axis. The
-                //  spacing between each pair of adjacent items is the same. The first item is flush with the
-                //  main-start edge, and the last item is flush with the main-end edge.
-                positions[0] = start;
-                if (item_count > 1) {
-                    float inc = free_space / (item_count - 1);
-                    float pos = start + items[0] + inc;
-                    for (int i = 1; i < item_count - 1; ++i) {
-                        positions[i] = pos;
-                        pos += items[i] + inc;
-                    }
-                    positions[item_count - 1] = end - items[item_count - 1];
-                }
-                break;
-            }
-            case container_alignment_t::space_around: {
-                // The items are evenly distributed within the alignment container along the main axis. The
-                // spacing between each pair of adjacent items is the same. The empty space before the first and
-                // after the last item equals half of the space between each pair of adjacent items.
-                float inc = free_space / item_count;
-                float pos = start + inc / 2;
-                for (int i = 0; i < item_count; ++i) {
-                    positions[i] = pos;
-                    pos += items[i] + inc;
-                }
-                break;
-            }
-            case container_alignment_t::space_evenly: {
-                // The items are evenly distributed within the alignment container along the main axis. The
-                // spacing between each pair of adjacent items, the main-start edge and the first item, and the
-                // main-end edge and the last item, are all exactly the same.
-                float inc = free_space / (item_count + 1);
-                float pos = start + inc;
-                for (int i = 0; i < item_count; ++i) {
-                    positions[i] = pos;
-                    pos += items[i] + inc;
-                }
-                break;
-            }
-        }
-
-        return positions;
+        // Like `overlaps`, the right and bottom edges aren't part of the rect
+        return rect.x <= x && x < rect.x + rect.width && rect.y <= y && y < rect.y + rect.height;
     }
 
     //---------------------------------------------------------------------------------------
-    void layout_t::private_t::layout_container(float start_x, float start_y, const item_t* parent)
+    inline rect_t offset_rect(const rect_t& rect, float dx, float dy)
     {
-        const bool horizontal = parent->cfg.horizontal;
+        return rect_t{rect.x + dx, rect.y + dy, rect.width, rect.height};
+    }
 
-        auto get_main_axis_available = [=](const item_t* item) -> float {
-            // const margin_t& m = item.cfg.margin;
-            //  Note, margins aren't counted as part of the item size, so they shouldn't be deducted when
-            //  calculating the item size
-            const padding_t& p = item->cfg.padding;
-            return horizontal ? item->cfg.width - (p.left + p.right) : item->cfg.height - (p.top + p.bottom);
+    //=======================================================================================
+    struct layout_t::private_t
+    {
+        // A row of items in a container. The items are stored in the scratch arrays, starting at `first_item`
+        struct row_t
+        {
+            int first_item = 0;
+            int item_count = 0;
+            float main_axis_size = 0;
+            float cross_axis_size = 0;
+            int flex_grow_count = 0;
+            int flex_shrink_count = 0;
+            float total_shrink_scaled_width = 0;
         };
 
-        auto get_cross_axis_available = [=](const item_t* item) -> float {
-            // const margin_t& m = item->cfg.margin;
-            const padding_t& p = item->cfg.padding;
-            return horizontal ? item->cfg.height - (p.top + p.bottom) : item->cfg.width - (p.left + p.right);
+        enum class trace_event_kind_t : uint8_t {
+            compute_layout,
+            render,
+            layout_container,
+            render_callback,
         };
 
-        auto get_main_axis_size = [=](const item_t* item) -> float {
-            const margin_t& m = item->cfg.margin;
-            return horizontal ? item->cfg.width + (m.left + m.right) : item->cfg.height + (m.top + m.bottom);
+        struct trace_event_t
+        {
+            trace_event_kind_t kind;
+            int item_id = 0;
+            int child_count = 0;
+            int depth = 0;
+            int64_t start_ns = 0;
+            int64_t duration_ns = 0;
         };
 
-        auto get_cross_axis_size = [=](const item_t* item) -> float {
-            const margin_t& m = item->cfg.margin;
-            return horizontal ? item->cfg.height + (m.top + m.bottom) : item->cfg.width + (m.left + m.right);
-        };
+        // Scratch buffers used when laying out a container. These are reused for every container, so once they
+        // have grown to fit the largest container, no memory is allocated during the layout
+        struct scratch_t
+        {
+            // The flex inputs of the items are gathered here, so the grow/shrink kernels can run over whole rows
+            std::vector<float> item_base_sizes;
+            std::vector<float> item_min_sizes;
+            std::vector<float> item_max_sizes;
+            std::vector<float> item_flex_grow;
+            std::vector<float> item_flex_shrink;
 
-        auto get_main_axis_min_size = [=](const item_t* item) -> float {
-            return horizontal ? item->cfg.min_width : item->cfg.min_height;
+            std::vector<float> item_main_axis_sizes;
+            std::vector<float> item_cross_axis_sizes;
+            std::vector<float> item_start;
+            std::vector<row_t> rows;
+            std::vector<float> row_sizes;
+            std::vector<float> row_start;
+
+            // The tree is walked without recursion, using these as the stack/queue of items left to visit
+            std::vector<int> pending;
+            std::vector<render_state_t> render_states;
+            std::vector<hit_entry_t> hit_stack;
+            std::vector<int> scrolled_ancestors;
+
+            // Each thread collects its own stats and trace events, and they're combined when they're read
+            layout_stats_t stats;
+            std::vector<trace_event_t> trace;
         };
 
-        auto get_main_axis_max_size = [=](const item_t* item) -> float {
-            return horizontal ? item->cfg.max_width : item->cfg.max_height;
-        };
+        private_t(const rect_t& layout_rect);
+        void reset(const rect_t& layout_rect);
+        void set_layout_cache(bool enabled);
 
-        auto get_cross_axis_min_size = [=](const item_t* item) -> float {
-            return horizontal ? item->cfg.min_width : item->cfg.min_height;
-        };
+        void push_config(packed_cfg_t&& cfg);
+        void pop_config();
 
-        auto get_cross_axis_max_size = [=](const item_t* item) -> float {
-            return horizontal ? item->cfg.max_width : item->cfg.max_height;
+        id add_item(packed_cfg_t&& cfg);
+        template <typename cfg_t>
+        id add_items(int parent_id, std::span<const cfg_t> cfgs);
+        id add_items(
+            int parent_id,
+            int count,
+            const packed_cfg_t& cfg,
+            std::span<const float> widths,
+            std::span<const float> heights);
+        id add_virtual_list(packed_cfg_t&& cfg, const virtual_list_cfg_t& list);
+        void update_virtual_list(id item_id, const virtual_list_cfg_t& list, int first_changed_row);
+        virtual_range_t get_virtual_list_range(id item_id) const;
+        rect_t get_virtual_list_row_rect(id item_id, int row);
+        double get_virtual_list_content_size(id item_id);
+        template <typename packed_t>
+        void apply_cfg(packed_t&& cfg, item_cfg_t& item_cfg, item_cold_t& item_cold);
+        void compute_layout();
+        void render();
+        void update_item(id item_id, packed_cfg_t&& cfg);
+        void set_layout_rect(const rect_t& layout_rect);
+        void set_traversal_order(traversal_order_t order);
+        void set_thread_pool(thread_pool_t* pool, int min_parallel_items);
+        void set_scissor_callbacks(begin_scissor_t begin, end_scissor_t end);
+        rect_t get_rect_for_item(id item_id);
+        rect_t get_content_rect(id item_id);
+        void get_children_offset(int item_id, float& dx, float& dy);
+        layout_stats_t get_stats() const;
+        void reset_stats();
+        layout_capacity_t get_capacity() const;
+        void set_tracing(bool enabled);
+        bool write_trace(const char* path) const;
+        void clear_trace();
+        void update_trace_depths();
+        void record_trace(scratch_t& scratch, trace_event_kind_t kind, int item_id, int64_t start_ns);
+
+        int push_item(const item_cfg_t& cfg, item_cold_t&& cold, uint64_t key);
+        void reserve_items(int count);
+        void update_child_index();
+        std::span<const int> children(int item_id) const;
+        void mark_dirty(int item_id);
+        void mark_bounds_dirty(int item_id);
+        void update_bounds(bounds_kind_t kind);
+        std::span<const int> children_near(
+            int item_id,
+            const render_state_t& state,
+            const rect_t& area,
+            bounds_kind_t kind) const;
+        id item_at(float x, float y);
+        void items_intersecting(const rect_t& area, std::vector<id>& items);
+
+        void layout1d(
+            container_alignment_t alignment,
+            float start,
+            float end,
+            std::span<const float> items,
+            std::span<float> positions);
+
+        void layout_children(float start_x, float start_y, int parent_id, scratch_t& scratch);
+        void build_cache_table();
+        int find_cached(uint64_t key, int cached_parent_id) const;
+        virtual_list_t* find_cached_list(uint64_t key);
+        void reconcile();
+        void layout_subtree(int root_id, int worker_index);
+        virtual_list_t& get_virtual_list(int item_id);
+        void measure_next_row(virtual_list_t& list);
+        double row_start(virtual_list_t& list, int row);
+        int row_at(virtual_list_t& list, double offset);
+        rect_t get_row_rect(virtual_list_t& list, const rect_t& rect, int row);
+        void update_virtual_ranges();
+        void share_scratch_capacity();
+        void render_tree();
+
+        // All the items are owned by these parallel arrays, and are indexed by their id. Releasing the layout frees
+        // the storage in one go, instead of once per item
+        std::vector<item_cfg_t> cfgs_;
+        std::vector<item_node_t> nodes_;
+        std::vector<rect_t> rects_;  // The usable area of each item after layout has been performed
+        std::vector<item_cold_t> cold_;
+        std::vector<uint64_t> keys_;  // The stable key of each item, which identifies it across frames
+        std::vector<virtual_list_t> lists_;
+
+        // The ids of the children of all items, grouped by parent (CSR style), so walking the tree reads memory
+        // sequentially instead of following a link per child
+        std::vector<int> child_index_;
+        bool child_index_dirty_ = true;
+
+        // For each item, the area where it, or any item below it, can be hit or drawn. See `update_bounds`
+        std::vector<rect_t> bounds_;
+        std::vector<sibling_extent_t> sibling_extents_;
+        std::vector<rect_t> draw_bounds_;
+        std::vector<sibling_extent_t> draw_extents_;
+
+        traversal_order_t traversal_order_ = traversal_order_t::depth_first;
+        thread_pool_t* thread_pool_ = nullptr;
+        int min_parallel_items_ = 0;
+        rect_t layout_rect_;
+        bool has_scroll_ = false;  // Set once any item has been given a scroll offset, until `reset`
+        bool has_clip_ = false;    // Set once any item has been given `clip`, until `reset`
+        begin_scissor_t begin_scissor_ = nullptr;
+        end_scissor_t end_scissor_ = nullptr;
+
+        // The config stack holds fully resolved configs, so adding an item only has to copy the top of the stack,
+        // and then apply the fields that are set in its own config
+        struct config_entry_t
+        {
+            item_cfg_t cfg;
+            item_cold_t cold;
+            uint32_t fields = 0;  // The fields set by the pushed configs (cfg_field_t)
         };
+        std::vector<config_entry_t> config_stack_;
 
-        const size_t child_count = parent->children.size();
+        // One set of scratch buffers per thread that can run the layout. The first one is used by the calling thread
+        std::vector<scratch_t> scratch_;
 
-        //=======================================================================================
-        // Split the items into rows
-        struct row_t
+        bool tracing_ = false;
+        int64_t trace_start_ns_ = 0;
+        std::vector<int> trace_depths_;  // The depth of each item, only filled in while tracing
+
+        // The tree from the previous frame, which `reset` swaps out of the arrays above when the layout cache is
+        // enabled. `table` finds the items by their key, using open addressing, and `prev_ids` holds the item from
+        // the previous frame that each new item was matched with
+        struct cache_t
         {
-            std::vector<item_t*> items;
-            std::vector<float> item_main_axis_sizes;
-            std::vector<float> item_cross_axis_sizes;
-            std::vector<float> item_start;
-            float main_axis_size = 0;
-            float cross_axis_size = 0;
-            int flex_grow_count = 0;
-            int flex_shrink_count = 0;
-            float total_shrink_scaled_width = 0;
+            std::vector<item_cfg_t> cfgs;
+            std::vector<item_node_t> nodes;
+            std::vector<rect_t> rects;
+            std::vector<uint64_t> keys;
+            std::vector<int> child_index;
+            std::vector<int> table;
+            std::vector<int> prev_ids;
+            std::vector<virtual_list_t> lists;
         };
+        bool cache_enabled_ = false;
+        bool reconcile_pending_ = false;  // Set by `reset`, until the new tree has been matched with the old one
+        cache_t cache_;
+    };
 
-        std::vector<row_t> rows;
-        row_t curr_row;
-
-        float curr_row_size = 0;
-        float main_axis_size = get_main_axis_available(parent);
-        float cross_axis_size = get_cross_axis_available(parent);
-
-        float cross_axis_used = 0;
+    //=======================================================================================
+    layout_t::private_t::private_t(const rect_t& layout_rect) : layout_rect_(layout_rect)
+    {
+        push_item({.width = layout_rect.width, .height = layout_rect.height}, {}, root_key);
+        rects_[0] = layout_rect;
+        scratch_.resize(1);
+    }
 
-        float curr_row_available = main_axis_size;
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::reset(const rect_t& layout_rect)
+    {
+        // Keep the current tree as the previous frame, by swapping it with the arrays of the frame before that
+        if (cache_enabled_) {
+            update_child_index();
+            cfgs_.swap(cache_.cfgs);
+            nodes_.swap(cache_.nodes);
+            rects_.swap(cache_.rects);
+            keys_.swap(cache_.keys);
+            child_index_.swap(cache_.child_index);
+            lists_.swap(cache_.lists);
+            build_cache_table();
+            reconcile_pending_ = true;
+        }
 
-        for (int i = 0; item_t * item : parent->children) {
-            float item_size = get_main_axis_size(item);
-            // We clamp here to handle the case where a single item is larger than the entire row
-            float clamped_item_size = flexy_min(main_axis_size, item_size);
-            curr_row_available -= clamped_item_size;
-            if (parent->cfg.wrap && curr_row_available < 0) {
-                // No space left on the current row, so store it
-                rows.push_back(curr_row);
-                cross_axis_used += curr_row.cross_axis_size;
-                curr_row = row_t{};
-                curr_row_available = main_axis_size;
-            }
+        // Only clear the arrays, so they keep their capacity
+        cfgs_.clear();
+        nodes_.clear();
+        rects_.clear();
+        cold_.clear();
+        keys_.clear();
+        lists_.clear();
+        has_scroll_ = false;
+        has_clip_ = false;
+        child_index_.clear();
+        child_index_dirty_ = true;
+        config_stack_.clear();
+
+        layout_rect_ = layout_rect;
+        push_item({.width = layout_rect.width, .height = layout_rect.height}, {}, root_key);
+        rects_[0] = layout_rect;
+    }
 
-            curr_row.items.push_back(item);
-            curr_row.item_main_axis_sizes.push_back(item_size);
-            curr_row.main_axis_size += item_size;
-            float cross_axis_size =
-                flexy_clamp(get_cross_axis_size(item), get_cross_axis_min_size(item), get_cross_axis_max_size(item));
-            curr_row.item_cross_axis_sizes.push_back(cross_axis_size);
-            curr_row.cross_axis_size = flexy_max(curr_row.cross_axis_size, cross_axis_size);
-            curr_row.flex_grow_count += item->cfg.flex_grow;
-            curr_row.flex_shrink_count += item->cfg.flex_shrink;
-            curr_row.total_shrink_scaled_width += item->cfg.flex_shrink * item_size;
-            ++i;
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_layout_cache(bool enabled)
+    {
+        cache_enabled_ = enabled;
+        if (!enabled) {
+            cache_ = {};
+            reconcile_pending_ = false;
         }
+    }
 
-        if (!curr_row.items.empty()) {
-            rows.push_back(curr_row);
-            cross_axis_used += curr_row.cross_axis_size;
+    //---------------------------------------------------------------------------------------
+    // Adds all the items of the previous frame to the lookup table
+    void layout_t::private_t::build_cache_table()
+    {
+        size_t size = 16;
+        while (size < cache_.nodes.size() * 2) {
+            size *= 2;
         }
+        cache_.table.assign(size, invalid_id);
 
-        //=======================================================================================
-        // Calculate the item sizes (using growth/shrink rules)
-        for (row_t& row : rows) {
-            if (row.main_axis_size > main_axis_size && row.flex_shrink_count > 0) {
-                // If flex_shrink_count is 0, then we don't resize any items
-                float delta = row.main_axis_size - main_axis_size;
-                float new_row_size = 0;
-                for (int i = 0; item_t * item : row.items) {
-                    // Reduce each item's size depending on the shrink_value
-                    // float s1 = float(item->cfg.flex_shrink) / row.flex_shrink_count;
-                    // Calculation from https://www.samanthaming.com/flexbox30/24-flex-shrink-calculation/
-                    float ratio = get_main_axis_size(item) * item->cfg.flex_shrink / row.total_shrink_scaled_width;
-                    float sz = flexy_max(get_main_axis_min_size(item), get_main_axis_size(item) - ratio * delta);
-                    row.item_main_axis_sizes[i] = sz;
-                    new_row_size += sz;
-                    ++i;
-                }
-                row.main_axis_size = new_row_size;
+        const size_t mask = size - 1;
+        for (int i = 0; i < (int)cache_.nodes.size(); ++i) {
+            size_t slot = (size_t)cache_.keys[i] & mask;
+            while (cache_.table[slot] != invalid_id) {
+                slot = (slot + 1) & mask;
             }
+            cache_.table[slot] = i;
+        }
+    }
 
-            if (row.main_axis_size < main_axis_size && row.flex_grow_count > 0) {
-                // There is some free space available, so resize
-                float delta = main_axis_size - row.main_axis_size;
-                float new_row_size = 0;
-                for (int i = 0; item_t * item : row.items) {
-                    // Increase each item's size depending on the shrink_value
-                    float sz = flexy_min(
-                        get_main_axis_max_size(item),
-                        get_main_axis_size(item) + delta * item->cfg.flex_grow / row.flex_grow_count);
-                    row.item_main_axis_sizes[i] = sz;
-                    new_row_size += sz;
-                    ++i;
-                }
-                row.main_axis_size = new_row_size;
+    //---------------------------------------------------------------------------------------
+    // Returns the item from the previous frame with the given key and parent, or invalid_id
+    int layout_t::private_t::find_cached(uint64_t key, int cached_parent_id) const
+    {
+        const size_t mask = cache_.table.size() - 1;
+        for (size_t slot = (size_t)key & mask; cache_.table[slot] != invalid_id; slot = (slot + 1) & mask) {
+            const int cached_id = cache_.table[slot];
+            if (cache_.keys[cached_id] == key && cache_.nodes[cached_id].parent == cached_parent_id) {
+                return cached_id;
             }
         }
+        return invalid_id;
+    }
 
-        //=======================================================================================
-        // Lay out the items
-
-        // justify-items: align items within a row along the main axis
-        // align-content: align rows along the cross axis
-        // align-items: align items within a row along the cross axis
-
-        // Lay out the items in each row along the main axis
-        for (row_t& row : rows) {
-            if (row.main_axis_size < main_axis_size) {
-                row.item_start = layout1d(parent->cfg.container_alignment, 0, main_axis_size, row.item_main_axis_sizes);
-            } else {
-                // The row is full, so just lay the items out one after another
-                float pos = 0;
-                for (int i = 0; item_t * item : row.items) {
-                    row.item_start.push_back(pos);
-                    pos += row.item_main_axis_sizes[i];
-                    ++i;
-                }
+    //---------------------------------------------------------------------------------------
+    // Returns the virtual list of the item from the previous frame with the given key, or nullptr. Lists are added
+    // along with their items, so they're in the order of their item ids, and can be found with a binary search
+    virtual_list_t* layout_t::private_t::find_cached_list(uint64_t key)
+    {
+        if (cache_.lists.empty()) {
+            return nullptr;
+        }
+        const size_t mask = cache_.table.size() - 1;
+        for (size_t slot = (size_t)key & mask; cache_.table[slot] != invalid_id; slot = (slot + 1) & mask) {
+            const int cached_id = cache_.table[slot];
+            if (cache_.keys[cached_id] != key) {
+                continue;
+            }
+            const auto it = std::lower_bound(
+                cache_.lists.begin(), cache_.lists.end(), cached_id, [](const virtual_list_t& list, int id) {
+                    return list.item_id < id;
+                });
+            if (it != cache_.lists.end() && it->item_id == cached_id) {
+                return &*it;
             }
         }
+        return nullptr;
+    }
 
-        std::vector<float> row_sizes;
-        std::vector<float> row_start;
-
-        // Lay out the rows along the cross axis
-        if (cross_axis_size > cross_axis_used) {
-            // We have cross axis space available, so lay out the rows
+    //---------------------------------------------------------------------------------------
+    // Matches the new tree with the one from the previous frame, starting from the roots. The children of matched
+    // items are matched by their position among their siblings, or by their key if the siblings have changed.
+    // Matched items start out with their rects from the previous frame, and a container is marked clean when its
+    // children would be laid out exactly the same as before, ie when it has the same config and position, and the
+    // same children, with the same configs, in the same order. Everything else is left dirty.
+    void layout_t::private_t::reconcile()
+    {
+        const int item_count = (int)nodes_.size();
+        std::vector<int>& prev_ids = cache_.prev_ids;
+        prev_ids.assign(item_count, invalid_id);
+        prev_ids[0] = 0;
+
+        // Parents always have lower ids than their children, so they're matched first
+        for (int item_id = 0; item_id < item_count; ++item_id) {
+            item_node_t& node = nodes_[item_id];
+            const int prev_id = prev_ids[item_id];
+            if (node.child_count == 0 || prev_id == invalid_id) {
+                continue;
+            }
 
-            if (parent->cfg.multi_row_alignment == container_alignment_t::stretch) {
-                // I'm doing my own version of stretch here, where I add the remaining space equally over the rows
-                float delta = (cross_axis_size - cross_axis_used) / rows.size();
-                float start = 0;
-                for (const row_t& row : rows) {
-                    row_sizes.push_back(row.cross_axis_size + delta);
-                    row_start.push_back(start);
-                    start += row_sizes.back();
+            const item_node_t& prev_node = cache_.nodes[prev_id];
+            const std::span<const int> child_ids = children(item_id);
+            const int* prev_child_ids = cache_.child_index.data() + prev_node.child_start;
+            bool clean = !prev_node.dirty && node.child_count == prev_node.child_count
+                         && same_layout(cfgs_[item_id], cache_.cfgs[prev_id]);
+            for (int i = 0; i < (int)child_ids.size(); ++i) {
+                const int c = child_ids[i];
+                int prev_c = invalid_id;
+                if (i < prev_node.child_count && cache_.keys[prev_child_ids[i]] == keys_[c]) {
+                    prev_c = prev_child_ids[i];
+                } else {
+                    prev_c = find_cached(keys_[c], prev_id);
+                    clean = false;
                 }
-            } else {
-                for (const row_t& row : rows) {
-                    row_sizes.push_back(row.cross_axis_size);
+                prev_ids[c] = prev_c;
+                if (prev_c != invalid_id) {
+                    rects_[c] = cache_.rects[prev_c];
+                    clean = clean && same_layout(cfgs_[c], cache_.cfgs[prev_c]);
                 }
-                row_start =
-                    layout1d((container_alignment_t)parent->cfg.multi_row_alignment, 0, cross_axis_size, row_sizes);
             }
-
-        } else {
-            // There is no additional space, so just lay the rows out one after another
-            float start = 0;
-            for (const row_t& row : rows) {
-                row_sizes.push_back(row.cross_axis_size);
-                row_start.push_back(start);
-                start += row_sizes.back();
+            if (item_id == 0) {
+                clean = clean && rects_[0].x == cache_.rects[0].x && rects_[0].y == cache_.rects[0].y;
             }
+
+            node.dirty = !clean;
+            node.subtree_dirty = !clean;
+            FLEXY_STATS_ADD(scratch_[0].stats, containers_cached, clean ? 1 : 0);
         }
 
-        // Now we can lay out the actual items in each row
-        for (int i = 0; row_t & row : rows) {
-            float curr_row_start = row_start[i];
-            float curr_row_size = row_sizes[i];
+        // Items without children never need to be laid out, and the parents of dirty items have to be visited.
+        // Children have higher ids than their parents, so walking backwards flags the whole path to the root
+        for (int item_id = item_count - 1; item_id >= 0; --item_id) {
+            item_node_t& node = nodes_[item_id];
+            if (node.child_count == 0) {
+                node.dirty = false;
+                node.subtree_dirty = false;
+            } else if (node.subtree_dirty && item_id > 0) {
+                nodes_[node.parent].subtree_dirty = true;
+            }
+        }
+    }
 
-            for (int j = 0; item_t * item : row.items) {
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::push_config(packed_cfg_t&& cfg)
+    {
+        // Start from the current top of the stack if `merge_config` is set, and then apply the supplied values
+        config_entry_t entry;
+        if (cfg.values.merge_config && !config_stack_.empty()) {
+            entry = config_stack_.back();
+        }
+        entry.fields |= cfg.fields & ~field_key;
+        apply_cfg(std::move(cfg), entry.cfg, entry.cold);
+        config_stack_.push_back(std::move(entry));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::pop_config()
+    {
+        config_stack_.pop_back();
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::private_t::add_item(packed_cfg_t&& cfg)
+    {
+        item_cfg_t local_cfg;
+        item_cold_t local_cold;
+        if (cfg.values.use_config_stack && !config_stack_.empty()) {
+            const config_entry_t& top = config_stack_.back();
+            local_cfg = top.cfg;
+            if (top.fields & cold_fields) {
+                local_cold = top.cold;
+            }
+        }
+        apply_cfg(std::move(cfg), local_cfg, local_cold);
+
+        // Initialize the item. The key isn't moved out of `cfg` by apply_cfg
+        assert(local_cfg.parent_id >= 0);
+        assert(local_cfg.parent_id < (int)nodes_.size());
+        assert(cold_[local_cfg.parent_id].virtual_list == invalid_id);
+        const uint64_t key = child_key(keys_[local_cfg.parent_id], cfg, nodes_[local_cfg.parent_id].child_count);
+        const int item_id = push_item(local_cfg, std::move(local_cold), key);
+
+        // Add the item to its parent (the default is the root container)
+        nodes_[item_id].parent = local_cfg.parent_id;
+        ++nodes_[local_cfg.parent_id].child_count;
+        child_index_dirty_ = true;
+        mark_dirty(local_cfg.parent_id);
+
+        return item_id;
+    }
+
+    //---------------------------------------------------------------------------------------
+    template <typename cfg_t>
+    id layout_t::private_t::add_items(int parent_id, std::span<const cfg_t> cfgs)
+    {
+        assert(parent_id >= 0);
+        assert(parent_id < (int)nodes_.size());
+        assert(cold_[parent_id].virtual_list == invalid_id);
+        const int first_id = (int)nodes_.size();
+        reserve_items((int)cfgs.size());
+
+        // The top of the config stack is the same for all the items, so only look it up once
+        const config_entry_t* top = config_stack_.empty() ? nullptr : &config_stack_.back();
+        auto add = [&](auto&& cfg, int sibling_index) {
+            item_cfg_t local_cfg;
+            item_cold_t local_cold;
+            if (cfg.values.use_config_stack && top) {
+                local_cfg = top->cfg;
+                if (top->fields & cold_fields) {
+                    local_cold = top->cold;
+                }
+            }
+            const uint64_t key = child_key(keys_[parent_id], cfg, sibling_index);
+            apply_cfg(std::forward<decltype(cfg)>(cfg), local_cfg, local_cold);
+            local_cfg.parent_id = parent_id;
+
+            const int item_id = push_item(local_cfg, std::move(local_cold), key);
+            nodes_[item_id].parent = parent_id;
+        };
+
+        const int first_sibling = nodes_[parent_id].child_count;
+        for (int i = 0; i < (int)cfgs.size(); ++i) {
+            if constexpr (std::is_same_v<cfg_t, packed_cfg_t>) {
+                add(cfgs[i], first_sibling + i);
+            } else {
+                add(packed_cfg_t(cfgs[i]), first_sibling + i);
+            }
+        }
+
+        // Link all the items to the parent at once
+        nodes_[parent_id].child_count += (int)cfgs.size();
+        child_index_dirty_ = true;
+        mark_dirty(parent_id);
+
+        return first_id;
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::private_t::add_items(
+        int parent_id,
+        int count,
+        const packed_cfg_t& cfg,
+        std::span<const float> widths,
+        std::span<const float> heights)
+    {
+        assert(parent_id >= 0);
+        assert(parent_id < (int)nodes_.size());
+        assert(cold_[parent_id].virtual_list == invalid_id);
+        assert(count >= 0);
+        assert(widths.empty() || (int)widths.size() == count);
+        assert(heights.empty() || (int)heights.size() == count);
+        const int first_id = (int)nodes_.size();
+
+        // The items are only told apart by their position, so a key in `cfg` would be shared by all of them
+        assert(!(cfg.fields & field_key));
+
+        // Resolve the config once, and then append copies of it
+        item_cfg_t local_cfg;
+        item_cold_t local_cold;
+        if (cfg.values.use_config_stack && !config_stack_.empty()) {
+            const config_entry_t& top = config_stack_.back();
+            local_cfg = top.cfg;
+            if (top.fields & cold_fields) {
+                local_cold = top.cold;
+            }
+        }
+        apply_cfg(cfg, local_cfg, local_cold);
+        local_cfg.parent_id = parent_id;
+
+        item_node_t node;
+        node.parent = parent_id;
+
+        reserve_items(count);
+        cfgs_.insert(cfgs_.end(), count, local_cfg);
+        nodes_.insert(nodes_.end(), count, node);
+        rects_.resize(rects_.size() + count);
+        cold_.insert(cold_.end(), count, local_cold);
+
+        const int first_sibling = nodes_[parent_id].child_count;
+        for (int i = 0; i < count; ++i) {
+            keys_.push_back(child_key(keys_[parent_id], cfg, first_sibling + i));
+        }
+
+        // Only the first `count` values are used, even if the asserts are compiled out
+        const int width_count = flexy_min(count, (int)widths.size());
+        const int height_count = flexy_min(count, (int)heights.size());
+        for (int i = 0; i < width_count; ++i) {
+            cfgs_[first_id + i].width = widths[i];
+        }
+        for (int i = 0; i < height_count; ++i) {
+            cfgs_[first_id + i].height = heights[i];
+        }
+
+        nodes_[parent_id].child_count += count;
+        child_index_dirty_ = true;
+        mark_dirty(parent_id);
+
+        return first_id;
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::private_t::add_virtual_list(packed_cfg_t&& cfg, const virtual_list_cfg_t& list)
+    {
+        assert(list.count >= 0);
+        assert(list.row_size_callback || list.row_size > 0);
+        const int item_id = add_item(std::move(cfg));
+        cold_[item_id].virtual_list = (int)lists_.size();
+        virtual_list_t& new_list = lists_.emplace_back();
+        new_list.item_id = item_id;
+        new_list.cfg = list;
+
+        // Take over the rows that the same list measured in the previous frame
+        virtual_list_t* prev = list.row_size_callback ? find_cached_list(keys_[item_id]) : nullptr;
+        if (prev && prev->cfg.row_size_callback == list.row_size_callback && prev->cfg.userdata == list.userdata) {
+            new_list.row_starts.swap(prev->row_starts);
+            if (new_list.row_starts.size() > (size_t)list.count + 1) {
+                new_list.row_starts.resize(list.count + 1);
+            }
+        }
+        return item_id;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::update_virtual_list(id item_id, const virtual_list_cfg_t& list, int first_changed_row)
+    {
+        assert(list.count >= 0);
+        assert(list.row_size_callback || list.row_size > 0);
+        assert(first_changed_row >= 0);
+        virtual_list_t& vl = get_virtual_list(item_id);
+        vl.cfg = list;
+
+        // Only the rows before the first changed one keep their start, and the end of the last of them
+        const size_t kept = (size_t)flexy_min(first_changed_row, list.count) + 1;
+        if (!list.row_size_callback) {
+            vl.row_starts.clear();
+        } else if (vl.row_starts.size() > kept) {
+            vl.row_starts.resize(kept);
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    virtual_range_t layout_t::private_t::get_virtual_list_range(id item_id) const
+    {
+        assert(item_id > 0);
+        assert(item_id < (int)cold_.size());
+        assert(cold_[item_id].virtual_list != invalid_id);
+        return lists_[cold_[item_id].virtual_list].range;
+    }
+
+    //---------------------------------------------------------------------------------------
+    rect_t layout_t::private_t::get_virtual_list_row_rect(id item_id, int row)
+    {
+        virtual_list_t& list = get_virtual_list(item_id);
+        assert(row >= 0);
+        assert(row < list.cfg.count);
+        return get_row_rect(list, get_rect_for_item(item_id), row);
+    }
+
+    //---------------------------------------------------------------------------------------
+    double layout_t::private_t::get_virtual_list_content_size(id item_id)
+    {
+        virtual_list_t& list = get_virtual_list(item_id);
+        return row_start(list, list.cfg.count);
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Applies the fields that are set in `cfg`. The values are moved out of `cfg` when it's an rvalue
+    template <typename packed_t>
+    void layout_t::private_t::apply_cfg(packed_t&& cfg, item_cfg_t& item_cfg, item_cold_t& item_cold)
+    {
+        const uint32_t fields = cfg.fields;
+#define APPLY(dst, x)                                 \
+    if (fields & field_##x) {                         \
+        dst.x = std::forward<packed_t>(cfg).values.x; \
+    }
+        APPLY(item_cfg, parent_id);
+        APPLY(item_cfg, width);
+        APPLY(item_cfg, height);
+        APPLY(item_cfg, min_width);
+        APPLY(item_cfg, min_height);
+        APPLY(item_cfg, max_width);
+        APPLY(item_cfg, max_height);
+        APPLY(item_cfg, flex_grow);
+        APPLY(item_cfg, flex_shrink);
+        APPLY(item_cfg, margin);
+        APPLY(item_cfg, padding);
+        APPLY(item_cfg, horizontal);
+        APPLY(item_cfg, wrap);
+        APPLY(item_cfg, container_alignment);
+        APPLY(item_cfg, multi_row_alignment);
+        APPLY(item_cfg, item_alignment);
+        APPLY(item_cold, userdata);
+        APPLY(item_cold, render_callback);
+        APPLY(item_cold, clip);
+        APPLY(item_cold, scroll_x);
+        APPLY(item_cold, scroll_y);
+#undef APPLY
+        if (fields & (field_scroll_x | field_scroll_y)) {
+            has_scroll_ = true;
+        }
+        if (fields & field_clip) {
+            has_clip_ = true;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    int layout_t::private_t::push_item(const item_cfg_t& cfg, item_cold_t&& cold, uint64_t key)
+    {
+        const int item_id = (int)cfgs_.size();
+        cfgs_.push_back(cfg);
+        nodes_.emplace_back();
+        rects_.emplace_back();
+        cold_.push_back(std::move(cold));
+        keys_.push_back(key);
+        return item_id;
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Makes room for `count` more items. The storage still grows geometrically, so adding many small batches
+    // doesn't reallocate for each of them
+    void layout_t::private_t::reserve_items(int count)
+    {
+        const size_t needed = cfgs_.size() + count;
+        if (needed <= cfgs_.capacity()) {
+            return;
+        }
+        const size_t capacity = needed > cfgs_.capacity() * 2 ? needed : cfgs_.capacity() * 2;
+        cfgs_.reserve(capacity);
+        nodes_.reserve(capacity);
+        rects_.reserve(capacity);
+        cold_.reserve(capacity);
+        keys_.reserve(capacity);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::update_item(id item_id, packed_cfg_t&& cfg)
+    {
+        assert(item_id > 0);
+        assert(item_id < (int)nodes_.size());
+        item_cfg_t& item_cfg = cfgs_[item_id];
+        item_cold_t& item_cold = cold_[item_id];
+
+        // Moving an item to a new parent, or changing its key, isn't supported
+        assert(!(cfg.fields & field_parent_id) || cfg.values.parent_id == item_cfg.parent_id);
+        assert(!(cfg.fields & field_key));
+
+        // Any change to the layout related fields means the item needs to be laid out again
+        const bool changed = (cfg.fields & ~(field_parent_id | field_key | cold_fields)) != 0;
+        const uint32_t fields = cfg.fields;
+        apply_cfg(std::move(cfg), item_cfg, item_cold);
+
+        // The bounds of a clipping item are its rect, so scrolling it doesn't change them
+        if ((fields & field_clip) || ((fields & (field_scroll_x | field_scroll_y)) && !item_cold.clip)) {
+            mark_bounds_dirty(item_id);
+        }
+        if (changed) {
+            // The item's own settings affect how its children are laid out, and its size affects how it, and
+            // its siblings, are laid out in the parent
+            mark_dirty(item_id);
+            mark_dirty(item_cfg.parent_id);
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_traversal_order(traversal_order_t order)
+    {
+        traversal_order_ = order;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_thread_pool(thread_pool_t* pool, int min_parallel_items)
+    {
+        thread_pool_ = pool;
+        min_parallel_items_ = min_parallel_items;
+
+        // The scratch of the workers that are no longer used is kept, along with the stats and trace events they
+        // collected, until the layout is destroyed
+        const size_t worker_count = pool ? (size_t)pool->worker_count() : 1;
+        if (scratch_.size() < worker_count) {
+            scratch_.resize(worker_count);
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_scissor_callbacks(begin_scissor_t begin, end_scissor_t end)
+    {
+        begin_scissor_ = begin;
+        end_scissor_ = end;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_layout_rect(const rect_t& layout_rect)
+    {
+        layout_rect_ = layout_rect;
+        cfgs_[0].width = layout_rect.width;
+        cfgs_[0].height = layout_rect.height;
+        rects_[0] = layout_rect;
+        mark_dirty(0);
+        mark_bounds_dirty(0);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::update_child_index()
+    {
+        if (!child_index_dirty_) {
+            return;
+        }
+
+        // Set each item's start to the end of its range, and then fill the ranges backwards. Children are added
+        // after their parents, and siblings in order, so walking the ids in reverse keeps the sibling order.
+        // This also means every child is visited before its parent, so the subtree sizes can be summed up here.
+        const int item_count = (int)nodes_.size();
+        int offset = 0;
+        for (item_node_t& node : nodes_) {
+            offset += node.child_count;
+            node.child_start = offset;
+            node.subtree_size = 1;
+        }
+
+        scratch_resize(child_index_, offset, scratch_[0].stats);
+        for (int i = item_count - 1; i > 0; --i) {
+            item_node_t& parent = nodes_[nodes_[i].parent];
+            child_index_[--parent.child_start] = i;
+            parent.subtree_size += nodes_[i].subtree_size;
+        }
+
+        child_index_dirty_ = false;
+    }
+
+    //---------------------------------------------------------------------------------------
+    std::span<const int> layout_t::private_t::children(int item_id) const
+    {
+        const item_node_t& node = nodes_[item_id];
+        return {child_index_.data() + node.child_start, (size_t)node.child_count};
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::mark_dirty(int item_id)
+    {
+        nodes_[item_id].dirty = true;
+
+        // Flag the path up to the root, so the layout can find the dirty items without visiting the whole tree
+        for (int cur = item_id; cur != invalid_id && !nodes_[cur].subtree_dirty; cur = nodes_[cur].parent) {
+            nodes_[cur].subtree_dirty = true;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::mark_bounds_dirty(int item_id)
+    {
+        for (int cur = item_id; cur != invalid_id && nodes_[cur].bounds_dirty != all_bounds;
+             cur = nodes_[cur].parent) {
+            nodes_[cur].bounds_dirty = all_bounds;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::layout1d(
+        container_alignment_t alignment,
+        float start,
+        float end,
+        std::span<const float> items,
+        std::span<float> positions)
+    {
+        assert(alignment >= container_alignment_t::start);
+        assert(alignment <= container_alignment_t::space_evenly);
+
+        float total_item_size = 0;
+        for (float sz : items) {
+            total_item_size += sz;
+        }
+
+        const float total_layout_size = end - start;
+        const float free_space = total_layout_size - total_item_size;
+        assert(total_layout_size >= total_item_size);
+
+        const size_t item_count = items.size();
+        assert(positions.size() == item_count);
+
+        switch (alignment) {
+                // see https://developer.mozilla.org/en-US/docs/Web/CSS/justify-content
+            case container_alignment_t::start:
+            case container_alignment_t::end:
+            case container_alignment_t::center: {
+                float pos;
+                if (alignment == container_alignment_t::start) {
+                    pos = 0;
+                } else if (alignment == container_alignment_t::end) {
+                    pos = start + free_space;
+                } else {
+                    // center
+                    pos = start + free_space / 2;
+                }
+                simd::prefix_positions(items.data(), item_count, pos, 0, positions.data());
+                break;
+            }
+            case container_alignment_t::space_between: {
+                //  The items are evenly distributed within the alignment container along the main axis. The
+                //  spacing between each pair of adjacent items is the same. The first item is flush with the
+                //  main-start edge, and the last item is flush with the main-end edge.
+                positions[0] = start;
+                if (item_count > 1) {
+                    float inc = free_space / (item_count - 1);
+                    simd::prefix_positions(items.data(), item_count - 1, start, inc, positions.data());
+                    positions[item_count - 1] = end - items[item_count - 1];
+                }
+                break;
+            }
+            case container_alignment_t::space_around: {
+                // The items are evenly distributed within the alignment container along the main axis. The
+                // spacing between each pair of adjacent items is the same. The empty space before the first and
+                // after the last item equals half of the space between each pair of adjacent items.
+                float inc = free_space / item_count;
+                simd::prefix_positions(items.data(), item_count, start + inc / 2, inc, positions.data());
+                break;
+            }
+            case container_alignment_t::space_evenly: {
+                // The items are evenly distributed within the alignment container along the main axis. The
+                // spacing between each pair of adjacent items, the main-start edge and the first item, and the
+                // main-end edge and the last item, are all exactly the same.
+                float inc = free_space / (item_count + 1);
+                simd::prefix_positions(items.data(), item_count, start + inc, inc, positions.data());
+                break;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::layout_children(float start_x, float start_y, int parent_id, scratch_t& scratch)
+    {
+        const item_cfg_t& parent = cfgs_[parent_id];
+        const bool horizontal = parent.horizontal;
+
+        auto get_main_axis_available = [=](const item_cfg_t& item) -> float {
+            // const margin_t& m = item.cfg.margin;
+            //  Note, margins aren't counted as part of the item size, so they shouldn't be deducted when
+            //  calculating the item size
+            const padding_t& p = item.padding;
+            return horizontal ? item.width - (p.left + p.right) : item.height - (p.top + p.bottom);
+        };
+
+        auto get_cross_axis_available = [=](const item_cfg_t& item) -> float {
+            // const margin_t& m = item.margin;
+            const padding_t& p = item.padding;
+            return horizontal ? item.height - (p.top + p.bottom) : item.width - (p.left + p.right);
+        };
+
+        auto get_main_axis_size = [=](const item_cfg_t& item) -> float {
+            const margin_t& m = item.margin;
+            return horizontal ? item.width + (m.left + m.right) : item.height + (m.top + m.bottom);
+        };
+
+        auto get_cross_axis_size = [=](const item_cfg_t& item) -> float {
+            const margin_t& m = item.margin;
+            return horizontal ? item.height + (m.top + m.bottom) : item.width + (m.left + m.right);
+        };
+
+        auto get_main_axis_min_size = [=](const item_cfg_t& item) -> float {
+            return horizontal ? item.min_width : item.min_height;
+        };
+
+        auto get_main_axis_max_size = [=](const item_cfg_t& item) -> float {
+            return horizontal ? item.max_width : item.max_height;
+        };
+
+        auto get_cross_axis_min_size = [=](const item_cfg_t& item) -> float {
+            return horizontal ? item.min_width : item.min_height;
+        };
+
+        auto get_cross_axis_max_size = [=](const item_cfg_t& item) -> float {
+            return horizontal ? item.max_width : item.max_height;
+        };
+
+        const std::span<const int> child_ids = children(parent_id);
+        const size_t child_count = child_ids.size();
+        if (child_count == 0) {
+            return;
+        }
+
+        layout_stats_t& stats = scratch.stats;
+        FLEXY_STATS_LAP_START(lap);
+
+        //=======================================================================================
+        // Split the items into rows
+        std::vector<float>& item_base_sizes = scratch.item_base_sizes;
+        std::vector<float>& item_min_sizes = scratch.item_min_sizes;
+        std::vector<float>& item_max_sizes = scratch.item_max_sizes;
+        std::vector<float>& item_flex_grow = scratch.item_flex_grow;
+        std::vector<float>& item_flex_shrink = scratch.item_flex_shrink;
+        std::vector<float>& item_main_axis_sizes = scratch.item_main_axis_sizes;
+        std::vector<float>& item_cross_axis_sizes = scratch.item_cross_axis_sizes;
+        std::vector<float>& item_start = scratch.item_start;
+        scratch_resize(item_base_sizes, child_count, stats);
+        scratch_resize(item_min_sizes, child_count, stats);
+        scratch_resize(item_max_sizes, child_count, stats);
+        scratch_resize(item_flex_grow, child_count, stats);
+        scratch_resize(item_flex_shrink, child_count, stats);
+        scratch_resize(item_main_axis_sizes, child_count, stats);
+        scratch_resize(item_cross_axis_sizes, child_count, stats);
+        scratch_resize(item_start, child_count, stats);
+
+        std::vector<row_t>& rows = scratch.rows;
+        rows.clear();
+        row_t curr_row;
+
+        float main_axis_size = get_main_axis_available(parent);
+        float cross_axis_size = get_cross_axis_available(parent);
+
+        float cross_axis_used = 0;
+
+        float curr_row_available = main_axis_size;
+
+        int i = 0;
+        for (int c : child_ids) {
+            const item_cfg_t& item = cfgs_[c];
+            float item_size = get_main_axis_size(item);
+            // We clamp here to handle the case where a single item is larger than the entire row
+            float clamped_item_size = flexy_min(main_axis_size, item_size);
+            curr_row_available -= clamped_item_size;
+            if (parent.wrap && curr_row_available < 0) {
+                // No space left on the current row, so store it
+                scratch_push(rows, curr_row, stats);
+                FLEXY_STATS_ADD(stats, items_wrapped, 1);
+                cross_axis_used += curr_row.cross_axis_size;
+                curr_row = row_t{.first_item = i};
+                curr_row_available = main_axis_size;
+            }
+
+            item_base_sizes[i] = item_size;
+            item_min_sizes[i] = get_main_axis_min_size(item);
+            item_max_sizes[i] = get_main_axis_max_size(item);
+            item_flex_grow[i] = (float)item.flex_grow;
+            item_flex_shrink[i] = (float)item.flex_shrink;
+            item_main_axis_sizes[i] = item_size;
+            curr_row.item_count++;
+            curr_row.main_axis_size += item_size;
+            float cross_axis_size =
+                flexy_clamp(get_cross_axis_size(item), get_cross_axis_min_size(item), get_cross_axis_max_size(item));
+            item_cross_axis_sizes[i] = cross_axis_size;
+            curr_row.cross_axis_size = flexy_max(curr_row.cross_axis_size, cross_axis_size);
+            curr_row.flex_grow_count += item.flex_grow;
+            curr_row.flex_shrink_count += item.flex_shrink;
+            curr_row.total_shrink_scaled_width += item.flex_shrink * item_size;
+            ++i;
+        }
+
+        if (curr_row.item_count > 0) {
+            scratch_push(rows, curr_row, stats);
+            cross_axis_used += curr_row.cross_axis_size;
+        }
+        FLEXY_STATS_ADD(stats, rows_created, (int64_t)rows.size());
+        FLEXY_STATS_LAP(lap, stats, row_split_ns);
+
+        //=======================================================================================
+        // Calculate the item sizes (using growth/shrink rules)
+        for (row_t& row : rows) {
+            const int first = row.first_item;
+            float* row_item_sizes = &item_main_axis_sizes[first];
+            if (row.main_axis_size > main_axis_size && row.flex_shrink_count > 0) {
+                // If flex_shrink_count is 0, then we don't resize any items
+                // Reduce each item's size depending on the shrink_value
+                // Calculation from https://www.samanthaming.com/flexbox30/24-flex-shrink-calculation/
+                float delta = row.main_axis_size - main_axis_size;
+                simd::flex_shrink(
+                    &item_base_sizes[first],
+                    &item_flex_shrink[first],
+                    &item_min_sizes[first],
+                    row.total_shrink_scaled_width,
+                    delta,
+                    row.item_count,
+                    row_item_sizes);
+                float new_row_size = 0;
+                for (int j = 0; j < row.item_count; ++j) {
+                    new_row_size += row_item_sizes[j];
+                }
+                row.main_axis_size = new_row_size;
+            }
+
+            if (row.main_axis_size < main_axis_size && row.flex_grow_count > 0) {
+                // There is some free space available, so increase each item's size depending on the grow value
+                float delta = main_axis_size - row.main_axis_size;
+                simd::flex_grow(
+                    &item_base_sizes[first],
+                    &item_flex_grow[first],
+                    &item_max_sizes[first],
+                    delta,
+                    (float)row.flex_grow_count,
+                    row.item_count,
+                    row_item_sizes);
+                float new_row_size = 0;
+                for (int j = 0; j < row.item_count; ++j) {
+                    new_row_size += row_item_sizes[j];
+                }
+                row.main_axis_size = new_row_size;
+            }
+        }
+
+        FLEXY_STATS_LAP(lap, stats, flex_ns);
+
+        //=======================================================================================
+        // Lay out the items
+
+        // justify-items: align items within a row along the main axis
+        // align-content: align rows along the cross axis
+        // align-items: align items within a row along the cross axis
+
+        // Lay out the items in each row along the main axis
+        for (const row_t& row : rows) {
+            std::span<const float> row_item_sizes(&item_main_axis_sizes[row.first_item], row.item_count);
+            std::span<float> row_item_start(&item_start[row.first_item], row.item_count);
+            if (row.main_axis_size < main_axis_size) {
+                layout1d(parent.container_alignment, 0, main_axis_size, row_item_sizes, row_item_start);
+            } else {
+                // The row is full, so just lay the items out one after another
+                simd::prefix_positions(row_item_sizes.data(), row.item_count, 0, 0, row_item_start.data());
+            }
+        }
+
+        FLEXY_STATS_LAP(lap, stats, main_axis_ns);
+
+        std::vector<float>& row_sizes = scratch.row_sizes;
+        std::vector<float>& row_start = scratch.row_start;
+        scratch_resize(row_sizes, rows.size(), stats);
+        scratch_resize(row_start, rows.size(), stats);
+
+        // Lay out the rows along the cross axis
+        if (cross_axis_size > cross_axis_used) {
+            // We have cross axis space available, so lay out the rows
+
+            if (parent.multi_row_alignment == container_alignment_t::stretch) {
+                // I'm doing my own version of stretch here, where I add the remaining space equally over the rows
+                float delta = (cross_axis_size - cross_axis_used) / rows.size();
+                float start = 0;
+                for (int r = 0; const row_t& row : rows) {
+                    row_sizes[r] = row.cross_axis_size + delta;
+                    row_start[r] = start;
+                    start += row_sizes[r];
+                    ++r;
+                }
+            } else {
+                for (int r = 0; const row_t& row : rows) {
+                    row_sizes[r] = row.cross_axis_size;
+                    ++r;
+                }
+                layout1d(
+                    (container_alignment_t)parent.multi_row_alignment, 0, cross_axis_size, row_sizes, row_start);
+            }
+
+        } else {
+            // There is no additional space, so just lay the rows out one after another
+            for (int r = 0; const row_t& row : rows) {
+                row_sizes[r] = row.cross_axis_size;
+                ++r;
+            }
+            simd::prefix_positions(row_sizes.data(), rows.size(), 0, 0, row_start.data());
+        }
+        FLEXY_STATS_LAP(lap, stats, cross_axis_ns);
+
+        // Now we can lay out the actual items in each row
+        for (int r = 0; const row_t& row : rows) {
+            float curr_row_start = row_start[r];
+            float curr_row_size = row_sizes[r];
+
+            const int row_end = row.first_item + row.item_count;
+            for (int j = row.first_item; j < row_end; ++j) {
+                const int item_id = child_ids[j];
+                const item_cfg_t& item = cfgs_[item_id];
+                rect_t& item_rect = rects_[item_id];
                 float cross_start, cross_end;
-                switch (parent->cfg.item_alignment) {
+                switch (parent.item_alignment) {
                     case item_alignment_t::start: {
                         cross_start = curr_row_start;
-                        cross_end = cross_start + row.item_cross_axis_sizes[j];
+                        cross_end = cross_start + item_cross_axis_sizes[j];
                         break;
                     }
                     case item_alignment_t::end: {
-                        cross_start = curr_row_start + curr_row_size - row.item_cross_axis_sizes[j];
-                        cross_end = cross_start + row.item_cross_axis_sizes[j];
+                        cross_start = curr_row_start + curr_row_size - item_cross_axis_sizes[j];
+                        cross_end = cross_start + item_cross_axis_sizes[j];
                         break;
                     }
                     case item_alignment_t::center: {
-                        cross_start = curr_row_start + (curr_row_size - row.item_cross_axis_sizes[j]) / 2;
-                        cross_end = cross_start + row.item_cross_axis_sizes[j];
+                        cross_start = curr_row_start + (curr_row_size - item_cross_axis_sizes[j]) / 2;
+                        cross_end = cross_start + item_cross_axis_sizes[j];
+                        break;
+                    }
+                    case item_alignment_t::stretch: {
+                        cross_start = curr_row_start;
+                        cross_end = curr_row_start + curr_row_size;
                         break;
                     }
-                    case item_alignment_t::stretch: {
-                        cross_start = curr_row_start;
-                        cross_end = curr_row_start + curr_row_size;
-                        break;
+                }
+
+                const margin_t& m = item.margin;
+                const padding_t& p = item.padding;
+
+                // Create the rectangle for the data we have
+                const rect_t prev_rect = item_rect;
+                if (horizontal) {
+                    item_rect = {
+                        start_x + item_start[j] + m.left + p.left,
+                        start_y + cross_start + m.top + p.top,
+                        item_main_axis_sizes[j] - (m.left + m.right + p.left + p.right),
+                        cross_end - cross_start - (m.top + m.bottom + p.top + p.bottom),
+                    };
+                } else {
+                    item_rect = {
+                        start_x + cross_start + m.left + p.left,
+                        start_y + item_start[j] + m.top + p.top,
+                        cross_end - cross_start - (m.left + m.right + p.left + p.right),
+                        item_main_axis_sizes[j] - (m.top + m.bottom + p.top + p.bottom),
+                    };
+                }
+
+                if (item_rect.x != prev_rect.x || item_rect.y != prev_rect.y || item_rect.width != prev_rect.width
+                    || item_rect.height != prev_rect.height) {
+                    nodes_[item_id].bounds_dirty = all_bounds;
+                }
+
+                // A clean item that has moved gets its children laid out again. Offsetting their rects instead would
+                // be cheaper, but the rects are kept from frame to frame, so the rounding would build up, and they
+                // would no longer match a fresh layout of the same tree
+                if (!nodes_[item_id].dirty && (item_rect.x != prev_rect.x || item_rect.y != prev_rect.y)) {
+                    nodes_[item_id].dirty = true;
+                    nodes_[item_id].subtree_dirty = true;
+                }
+            }
+            ++r;
+        }
+        FLEXY_STATS_LAP(lap, stats, rect_ns);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::layout_subtree(int root_id, int worker_index)
+    {
+        // Walk the dirty parts of the tree using an explicit stack or queue, so deep trees can't overflow the call
+        // stack. A container is always laid out before its children are visited, so the order only affects how
+        // memory is accessed, and not the result.
+        const bool breadth_first = traversal_order_ == traversal_order_t::breadth_first;
+        scratch_t& scratch = scratch_[worker_index];
+        std::vector<int>& pending = scratch.pending;
+        pending.clear();
+        scratch_push(pending, root_id, scratch.stats);
+
+        size_t head = 0;
+        while (head < pending.size()) {
+            int parent_id;
+            if (breadth_first) {
+                parent_id = pending[head++];
+            } else {
+                parent_id = pending.back();
+                pending.pop_back();
+            }
+
+            FLEXY_STATS_ADD(scratch.stats, containers_visited, 1);
+            item_node_t& parent = nodes_[parent_id];
+            parent.bounds_dirty = all_bounds;
+            if (parent.dirty) {
+                const int64_t trace_start = tracing_ ? trace_clock_ns() : 0;
+                layout_children(rects_[parent_id].x, rects_[parent_id].y, parent_id, scratch);
+                if (tracing_) {
+                    record_trace(scratch, trace_event_kind_t::layout_container, parent_id, trace_start);
+                }
+                parent.dirty = false;
+            }
+            parent.subtree_dirty = false;
+
+            // Only visit the parts of the tree that have changed. When using a stack, the children are pushed in
+            // reverse, so they are still visited in order.
+            // Once a container is laid out, the subtrees of its children are independent of each other, so large
+            // ones are handed to the thread pool instead. One of them is kept on this thread, which would otherwise
+            // only wait for it, so a chain of single large children doesn't become one task per container.
+            // Items without children have nothing to lay out, so they're marked clean here instead of being visited
+            const std::span<const int> child_ids = children(parent_id);
+            bool kept_large_child = false;
+            for (size_t i = 0; i < child_ids.size(); ++i) {
+                const int c = child_ids[breadth_first ? i : child_ids.size() - 1 - i];
+                if (!nodes_[c].subtree_dirty) {
+                    continue;
+                }
+                if (nodes_[c].child_count == 0) {
+                    nodes_[c].dirty = false;
+                    nodes_[c].subtree_dirty = false;
+                    continue;
+                }
+                if (thread_pool_ && nodes_[c].subtree_size >= min_parallel_items_ && kept_large_child) {
+                    thread_pool_->submit([this, c](int worker_index) { layout_subtree(c, worker_index); });
+                } else {
+                    kept_large_child = kept_large_child || nodes_[c].subtree_size >= min_parallel_items_;
+                    scratch_push(pending, c, scratch.stats);
+                }
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    virtual_list_t& layout_t::private_t::get_virtual_list(int item_id)
+    {
+        assert(item_id > 0);
+        assert(item_id < (int)cold_.size());
+        assert(cold_[item_id].virtual_list != invalid_id);
+        return lists_[cold_[item_id].virtual_list];
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::measure_next_row(virtual_list_t& list)
+    {
+        std::vector<double>& starts = list.row_starts;
+        if (starts.empty()) {
+            starts.push_back(0);
+        }
+        const int row = (int)starts.size() - 1;
+        starts.push_back(starts.back() + list.cfg.row_size_callback(list.cfg.userdata, row));
+    }
+
+    //---------------------------------------------------------------------------------------
+    // The distance from the start of the list to the start of `row`. `row` can be one past the last row
+    double layout_t::private_t::row_start(virtual_list_t& list, int row)
+    {
+        if (!list.cfg.row_size_callback) {
+            return row * (double)list.cfg.row_size;
+        }
+        while ((int)list.row_starts.size() <= row) {
+            measure_next_row(list);
+        }
+        return list.row_starts[row];
+    }
+
+    //---------------------------------------------------------------------------------------
+    // The row at `offset` from the start of the list, clamped to the rows in the list
+    int layout_t::private_t::row_at(virtual_list_t& list, double offset)
+    {
+        const int count = list.cfg.count;
+        assert(count > 0);
+        if (!list.cfg.row_size_callback) {
+            return (int)flexy_clamp(floor(offset / list.cfg.row_size), 0.0, double(count - 1));
+        }
+
+        // Measure the rows until one of them ends after the offset
+        std::vector<double>& starts = list.row_starts;
+        while (starts.empty() || (starts.back() <= offset && (int)starts.size() <= count)) {
+            measure_next_row(list);
+        }
+        const int row = (int)(std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin()) - 1;
+        return flexy_clamp(row, 0, count - 1);
+    }
+
+    //---------------------------------------------------------------------------------------
+    // `rect` is the rect of the list, as it's rendered
+    rect_t layout_t::private_t::get_row_rect(virtual_list_t& list, const rect_t& rect, int row)
+    {
+        // The position is relative to the scroll position before it's converted to a float, so rows near the
+        // visible part of the list are placed exactly, however far down the list they are
+        const double start = row_start(list, row);
+        const float size = list.cfg.row_size_callback ? (float)(row_start(list, row + 1) - start) : list.cfg.row_size;
+        const float pos = (float)(start - list.cfg.scroll);
+        if (cfgs_[list.item_id].horizontal) {
+            return rect_t{rect.x + pos, rect.y, size, rect.height};
+        }
+        return rect_t{rect.x, rect.y + pos, rect.width, size};
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Finds the rows of each virtual list that are within the layout rect, and adds the overscan on both sides
+    void layout_t::private_t::update_virtual_ranges()
+    {
+        for (virtual_list_t& list : lists_) {
+            const rect_t rect = get_rect_for_item(list.item_id);
+            list.range = {};
+            if (list.cfg.count == 0 || !overlaps(rect, layout_rect_)) {
+                continue;
+            }
+
+            const rect_t visible = intersect(rect, layout_rect_);
+            const bool horizontal = cfgs_[list.item_id].horizontal;
+            const double begin = list.cfg.scroll + (horizontal ? visible.x - rect.x : visible.y - rect.y);
+            const double end = begin + (horizontal ? visible.width : visible.height);
+            int first = row_at(list, begin);
+            int last = row_at(list, end);
+            if (last > first && row_start(list, last) >= end) {
+                --last;
+            }
+            first = flexy_max(first - list.cfg.overscan, 0);
+            last = flexy_min(last + list.cfg.overscan, list.cfg.count - 1);
+            list.range = {first, last - first + 1};
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::render_tree()
+    {
+        // Items are rendered depth first, with each item drawn before its children, and siblings in the order they
+        // were added. An item is only drawn if it overlaps the current clip rect, which starts out as the layout rect.
+        // The children of a clipping or scrolled item are pushed on top of an end marker (~item_id), that restores
+        // the outer clip rect and scroll offset once they have all been rendered.
+        // The children of clipping items are culled by their bounds, which are updated first, as they share the stack
+        if (has_clip_) {
+            update_bounds(draw_bounds);
+        }
+        std::vector<int>& pending = scratch_[0].pending;
+        std::vector<render_state_t>& states = scratch_[0].render_states;
+        layout_stats_t& stats = scratch_[0].stats;
+        states.clear();
+        scratch_push(states, render_state_t{layout_rect_}, stats);
+        pending.clear();
+        scratch_push(pending, 0, stats);
+        while (!pending.empty()) {
+            const int item_id = pending.back();
+            pending.pop_back();
+
+            if (item_id < 0) {
+                states.pop_back();
+                if (begin_scissor_ && cold_[~item_id].clip) {
+                    begin_scissor_(states.back().clip);
+                }
+                continue;
+            }
+
+            // Scrolling only moves the items as they're rendered, the layout doesn't depend on it
+            const render_state_t state = states.back();
+            const rect_t rect = offset_rect(rects_[item_id], state.offset_x, state.offset_y);
+            const item_cold_t& cold = cold_[item_id];
+            const bool visible = item_id == 0 || overlaps(rect, state.clip);
+            if (!visible) {
+                FLEXY_STATS_ADD(stats, items_culled, 1);
+            } else if (item_id != 0 && cold.render_callback) {
+                const int64_t trace_start = tracing_ ? trace_clock_ns() : 0;
+                FLEXY_STATS_LAP_START(lap);
+                cold.render_callback(cold.userdata, rect);
+                FLEXY_STATS_LAP(lap, stats, render_callback_ns);
+                FLEXY_STATS_ADD(stats, items_drawn, 1);
+                if (tracing_) {
+                    record_trace(scratch_[0], trace_event_kind_t::render_callback, item_id, trace_start);
+                }
+            }
+
+            // The rows of a virtual list are always clipped to the list
+            if (cold.virtual_list != invalid_id) {
+                virtual_list_t& list = lists_[cold.virtual_list];
+                if (!visible) {
+                    FLEXY_STATS_ADD(stats, items_culled, list.range.count);
+                    continue;
+                }
+                const rect_t list_clip = intersect(rect, state.clip);
+                if (begin_scissor_) {
+                    begin_scissor_(list_clip);
+                }
+                FLEXY_STATS_LAP_START(lap);
+                for (int row = list.range.first; row < list.range.first + list.range.count; ++row) {
+                    const rect_t row_rect = get_row_rect(list, rect, row);
+                    if (!overlaps(row_rect, list_clip)) {
+                        FLEXY_STATS_ADD(stats, items_culled, 1);
+                    } else if (list.cfg.render_row) {
+                        list.cfg.render_row(list.cfg.userdata, row, row_rect);
+                        FLEXY_STATS_ADD(stats, items_drawn, 1);
+                    }
+                }
+                FLEXY_STATS_LAP(lap, stats, render_callback_ns);
+                if (begin_scissor_) {
+                    begin_scissor_(state.clip);
+                }
+                continue;
+            }
+
+            // Without clipping, the children can extend outside the item, so they're still visited even if the
+            // item itself isn't drawn
+            const std::span<const int> child_ids = children(item_id);
+            const bool scrolled = cold.scroll_x != 0 || cold.scroll_y != 0;
+            if ((cold.clip || scrolled) && !child_ids.empty()) {
+                if (cold.clip && !visible) {
+                    FLEXY_STATS_ADD(stats, items_culled, nodes_[item_id].subtree_size - 1);
+                    continue;
+                }
+                const render_state_t inner = {
+                    cold.clip ? intersect(rect, state.clip) : state.clip,
+                    state.offset_x - cold.scroll_x,
+                    state.offset_y - cold.scroll_y,
+                };
+                scratch_push(states, inner, stats);
+                if (begin_scissor_ && cold.clip) {
+                    begin_scissor_(inner.clip);
+                }
+                scratch_push(pending, ~item_id, stats);
+
+                // Only the children whose bounds can reach the clip rect are visited, so scrolling through a long
+                // list of children doesn't touch the ones that are out of view. The others have nothing in their
+                // subtree that overlaps it, so this draws the same items as visiting all of them
+                if (cold.clip) {
+                    const std::span<const int> visible_ids = children_near(item_id, inner, inner.clip, draw_bounds);
+                    FLEXY_STATS_ADD(stats, items_culled, nodes_[item_id].subtree_size - 1);
+                    for (size_t i = visible_ids.size(); i > 0; --i) {
+                        FLEXY_STATS_ADD(stats, items_culled, -nodes_[visible_ids[i - 1]].subtree_size);
+                        scratch_push(pending, visible_ids[i - 1], stats);
+                    }
+                    continue;
+                }
+            }
+            for (size_t i = child_ids.size(); i > 0; --i) {
+                scratch_push(pending, child_ids[i - 1], stats);
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Any worker can be handed any subtree in the next frame, so the layout buffers of every worker are grown to the
+    // largest size any of them has needed. Otherwise a worker could still allocate the first time it gets a large
+    // container, long after the layout has warmed up
+    void layout_t::private_t::share_scratch_capacity()
+    {
+        auto share = [this](auto member) {
+            size_t capacity = 0;
+            for (const scratch_t& scratch : scratch_) {
+                capacity = flexy_max((scratch.*member).capacity(), capacity);
+            }
+            for (scratch_t& scratch : scratch_) {
+                FLEXY_STATS_ADD(scratch.stats, scratch_growths, capacity > (scratch.*member).capacity() ? 1 : 0);
+                (scratch.*member).reserve(capacity);
+            }
+        };
+        share(&scratch_t::item_base_sizes);
+        share(&scratch_t::item_min_sizes);
+        share(&scratch_t::item_max_sizes);
+        share(&scratch_t::item_flex_grow);
+        share(&scratch_t::item_flex_shrink);
+        share(&scratch_t::item_main_axis_sizes);
+        share(&scratch_t::item_cross_axis_sizes);
+        share(&scratch_t::item_start);
+        share(&scratch_t::rows);
+        share(&scratch_t::row_sizes);
+        share(&scratch_t::row_start);
+        share(&scratch_t::pending);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::compute_layout()
+    {
+        const int64_t trace_start = tracing_ ? trace_clock_ns() : 0;
+        update_child_index();
+        if (tracing_) {
+            update_trace_depths();
+        }
+        if (reconcile_pending_) {
+            reconcile();
+            reconcile_pending_ = false;
+        }
+
+        if (nodes_[0].subtree_dirty) {
+            layout_subtree(0, 0);
+            if (thread_pool_) {
+                thread_pool_->wait();
+                share_scratch_capacity();
+            }
+        }
+        update_virtual_ranges();
+
+        if (tracing_) {
+            record_trace(scratch_[0], trace_event_kind_t::compute_layout, 0, trace_start);
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::render()
+    {
+        const int64_t trace_start = tracing_ ? trace_clock_ns() : 0;
+        update_child_index();
+        if (tracing_) {
+            update_trace_depths();
+        }
+
+        // Add a scissor rect to disallow drawing outside the main layout
+        if (begin_scissor_) {
+            begin_scissor_(layout_rect_);
+        }
+        render_tree();
+        if (end_scissor_) {
+            end_scissor_();
+        }
+
+        // Rendering shares the pending stack of worker 0, which can grow past what the layout needed
+        if (thread_pool_) {
+            share_scratch_capacity();
+        }
+
+        if (tracing_) {
+            record_trace(scratch_[0], trace_event_kind_t::render, 0, trace_start);
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    rect_t layout_t::private_t::get_rect_for_item(id item_id)
+    {
+        assert(item_id >= 0);
+        assert(item_id < (int)rects_.size());
+
+        if (item_id >= 0 && item_id < (int)rects_.size()) {
+            float dx, dy;
+            get_children_offset(nodes_[item_id].parent, dx, dy);
+            return offset_rect(rects_[item_id], dx, dy);
+        }
+        return rect_t{};
+    }
+
+    //---------------------------------------------------------------------------------------
+    rect_t layout_t::private_t::get_content_rect(id item_id)
+    {
+        assert(item_id >= 0);
+        assert(item_id < (int)rects_.size());
+        update_child_index();
+
+        const std::span<const int> child_ids = children(item_id);
+        if (child_ids.empty()) {
+            return rect_t{};
+        }
+        float x0 = FLT_MAX;
+        float y0 = FLT_MAX;
+        float x1 = -FLT_MAX;
+        float y1 = -FLT_MAX;
+        for (const int c : child_ids) {
+            const rect_t& r = rects_[c];
+            const margin_t& m = cfgs_[c].margin;
+            const padding_t& p = cfgs_[c].padding;
+            x0 = flexy_min(x0, r.x - (p.left + m.left));
+            y0 = flexy_min(y0, r.y - (p.top + m.top));
+            x1 = flexy_max(x1, r.x + r.width + (p.right + m.right));
+            y1 = flexy_max(y1, r.y + r.height + (p.bottom + m.bottom));
+        }
+        const rect_t& rect = rects_[item_id];
+        return rect_t{x0 - rect.x, y0 - rect.y, x1 - x0, y1 - y0};
+    }
+
+    //---------------------------------------------------------------------------------------
+    // How far the children of `item_id` are moved when they're rendered, by the scroll offsets of the item and its
+    // ancestors. The scrolled ancestors are collected first, and their offsets are then added from the root down,
+    // the same way `render_tree` does, so the results match exactly
+    void layout_t::private_t::get_children_offset(int item_id, float& dx, float& dy)
+    {
+        dx = 0;
+        dy = 0;
+        if (!has_scroll_) {
+            return;
+        }
+        std::vector<int>& scrolled = scratch_[0].scrolled_ancestors;
+        scrolled.clear();
+        for (int cur = item_id; cur > 0; cur = nodes_[cur].parent) {
+            if (cold_[cur].scroll_x != 0 || cold_[cur].scroll_y != 0) {
+                scratch_push(scrolled, cur, scratch_[0].stats);
+            }
+        }
+        for (size_t i = scrolled.size(); i > 0; --i) {
+            dx -= cold_[scrolled[i - 1]].scroll_x;
+            dy -= cold_[scrolled[i - 1]].scroll_y;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Recomputes the bounds of the given kind for the items that have changed since they were last used. The bounds
+    // of an item cover everything in its subtree that can be hit or drawn, in the item's own coordinates (ie not moved
+    // by the scroll offsets of its ancestors). Only items with an area can be hit, but `overlaps` also draws items
+    // with a zero or negative size, so the draw bounds cover the span between the edges of every rect that isn't NaN.
+    // Nothing below a clipping item can be hit or drawn outside of it, so its bounds are just its rect.
+    // An item is flagged whenever the layout changes its rect, or its scroll offset or clipping changes, along with
+    // the path up to the root, so only those items are visited here
+    void layout_t::private_t::update_bounds(bounds_kind_t kind)
+    {
+        const bool draw = kind == draw_bounds;
+        std::vector<rect_t>& bounds = draw ? draw_bounds_ : bounds_;
+        std::vector<sibling_extent_t>& extents = draw ? draw_extents_ : sibling_extents_;
+        update_child_index();
+        bounds.resize(nodes_.size());
+        extents.resize(nodes_.size());
+        if (!(nodes_[0].bounds_dirty & kind)) {
+            return;
+        }
+
+        // Each item is pushed twice: first to push its dirty children, and then, as ~item_id, once their bounds
+        // are known
+        std::vector<int>& pending = scratch_[0].pending;
+        layout_stats_t& stats = scratch_[0].stats;
+        pending.clear();
+        scratch_push(pending, 0, stats);
+        while (!pending.empty()) {
+            const int entry = pending.back();
+            if (entry >= 0) {
+                pending.back() = ~entry;
+                for (const int c : children(entry)) {
+                    if (nodes_[c].bounds_dirty & kind) {
+                        scratch_push(pending, c, stats);
+                    }
+                }
+                continue;
+            }
+            pending.pop_back();
+
+            const int item_id = ~entry;
+            const std::span<const int> child_ids = children(item_id);
+            const item_cold_t& cold = cold_[item_id];
+            const rect_t& rect = rects_[item_id];
+            nodes_[item_id].bounds_dirty &= ~kind;
+
+            // The part of the layout covered by the item itself, if anything
+            const bool has_extent = draw
+                                        ? !isnan(rect.x) && !isnan(rect.y) && !isnan(rect.width) && !isnan(rect.height)
+                                        : rect.width > 0 && rect.height > 0;
+            const float rect_x0 = flexy_min(rect.x, rect.x + rect.width);
+            const float rect_y0 = flexy_min(rect.y, rect.y + rect.height);
+            const float rect_x1 = flexy_max(rect.x, rect.x + rect.width);
+            const float rect_y1 = flexy_max(rect.y, rect.y + rect.height);
+            auto has_bounds = [draw](const rect_t& b) {
+                return draw ? b.width >= 0 && b.height >= 0 : b.width > 0 && b.height > 0;
+            };
+
+            // The bounds are only used to skip subtrees, so they're grown by a small margin to cover the rounding
+            // differences between moving them by the scroll offsets and moving each item when it's rendered
+            auto margin = [&](float x0, float y0, float x1, float y1) {
+                const float scale = fabsf(x0) + fabsf(y0) + fabsf(x1) + fabsf(y1);
+                return (scale + fabsf(cold.scroll_x) + fabsf(cold.scroll_y) + 1) * FLT_EPSILON * 64;
+            };
+            const bool scrolled = cold.scroll_x != 0 || cold.scroll_y != 0;
+            const float inside_margin = scrolled ? margin(rect_x0, rect_y0, rect_x1, rect_y1) : 0.f;
+
+            // Grow the item's rect to fit the bounds of the children, as they're moved by the item's scroll offset.
+            // The new values come first in flexy_min/flexy_max, so a NaN is ignored instead of spreading
+            float x0 = has_extent ? rect_x0 : FLT_MAX;
+            float y0 = has_extent ? rect_y0 : FLT_MAX;
+            float x1 = has_extent ? rect_x1 : -FLT_MAX;
+            float y1 = has_extent ? rect_y1 : -FLT_MAX;
+            bool inside = true;
+            sibling_extent_t extent;
+            for (const int c : child_ids) {
+                const rect_t& b = bounds[c];
+                if (has_bounds(b)) {
+                    extent.end_x = flexy_max(b.x + b.width, extent.end_x);
+                    extent.end_y = flexy_max(b.y + b.height, extent.end_y);
+                    if (!cold.clip) {
+                        const float bx0 = b.x - cold.scroll_x;
+                        const float by0 = b.y - cold.scroll_y;
+                        const float bx1 = bx0 + b.width;
+                        const float by1 = by0 + b.height;
+                        inside = inside && has_extent && bx0 >= rect_x0 + inside_margin
+                                 && by0 >= rect_y0 + inside_margin && bx1 <= rect_x1 - inside_margin
+                                 && by1 <= rect_y1 - inside_margin;
+                        x0 = flexy_min(bx0, x0);
+                        y0 = flexy_min(by0, y0);
+                        x1 = flexy_max(bx1, x1);
+                        y1 = flexy_max(by1, y1);
                     }
                 }
+                extents[c].end_x = extent.end_x;
+                extents[c].end_y = extent.end_y;
+            }
+            for (size_t i = child_ids.size(); i > 0; --i) {
+                const rect_t& b = bounds[child_ids[i - 1]];
+                if (has_bounds(b)) {
+                    extent.start_x = flexy_min(b.x, extent.start_x);
+                    extent.start_y = flexy_min(b.y, extent.start_y);
+                }
+                extents[child_ids[i - 1]].start_x = extent.start_x;
+                extents[child_ids[i - 1]].start_y = extent.start_y;
+            }
 
-                const margin_t& m = item->cfg.margin;
-                const padding_t& p = item->cfg.padding;
+            if (cold.clip || inside) {
+                bounds[item_id] =
+                    has_extent ? rect_t{rect_x0, rect_y0, rect_x1 - rect_x0, rect_y1 - rect_y0} : no_bounds;
+            } else if (draw ? x1 >= x0 && y1 >= y0 : x1 > x0 && y1 > y0) {
+                const float m = margin(x0, y0, x1, y1);
+                bounds[item_id] = rect_t{x0 - m, y0 - m, x1 - x0 + 2 * m, y1 - y0 + 2 * m};
+            } else {
+                bounds[item_id] = no_bounds;
+            }
+        }
+    }
 
-                // Create the rectangle for the data we have, and invoke the render callback
-                if (horizontal) {
-                    item->computed_rect = {
-                        start_x + row.item_start[j] + m.left + p.left,
-                        start_y + cross_start + m.top + p.top,
-                        row.item_main_axis_sizes[j] - (m.left + m.right + p.left + p.right),
-                        cross_end - cross_start - (m.top + m.bottom + p.top + p.bottom),
-                    };
-                } else {
-                    item->computed_rect = {
-                        start_x + cross_start + m.left + p.left,
-                        start_y + row.item_start[j] + m.top + p.top,
-                        cross_end - cross_start - (m.left + m.right + p.left + p.right),
-                        row.item_main_axis_sizes[j] - (m.top + m.bottom + p.top + p.bottom),
-                    };
-                }
+    //---------------------------------------------------------------------------------------
+    // The children of `item_id` whose bounds can overlap `area`, when they're rendered with `state`: the ones from the
+    // first that reaches the area, to the last that starts before its end, along both axes. Uses the sibling extents
+    // of the given kind from `update_bounds`, so the children that are left out don't have to be looked at
+    std::span<const int> layout_t::private_t::children_near(
+        int item_id,
+        const render_state_t& state,
+        const rect_t& area,
+        bounds_kind_t kind) const
+    {
+        const std::vector<sibling_extent_t>& extents = kind == draw_bounds ? draw_extents_ : sibling_extents_;
+        const std::span<const int> child_ids = children(item_id);
+        if (child_ids.empty()) {
+            return child_ids;
+        }
+
+        // The area is moved into the children's coordinates, which rounds differently than moving each child, so
+        // it's grown by a small margin
+        const float x0 = area.x - state.offset_x;
+        const float y0 = area.y - state.offset_y;
+        const float x1 = x0 + area.width;
+        const float y1 = y0 + area.height;
+        const float scale = fabsf(x0) + fabsf(y0) + fabsf(x1) + fabsf(y1);
+        const float m = (scale + fabsf(state.offset_x) + fabsf(state.offset_y) + 1) * FLT_EPSILON * 64;
+
+        auto before_x = [&](int c) { return !(extents[c].end_x > x0 - m); };
+        auto before_y = [&](int c) { return !(extents[c].end_y > y0 - m); };
+        auto starts_x = [&](int c) { return extents[c].start_x < x1 + m; };
+        auto starts_y = [&](int c) { return extents[c].start_y < y1 + m; };
+        const auto first = std::max(
+            std::partition_point(child_ids.begin(), child_ids.end(), before_x),
+            std::partition_point(child_ids.begin(), child_ids.end(), before_y));
+        const auto last = std::min(
+            std::partition_point(first, child_ids.end(), starts_x),
+            std::partition_point(first, child_ids.end(), starts_y));
+        return first < last ? std::span<const int>(first, last) : std::span<const int>();
+    }
 
-                if (item->cfg.render_callback) {
-                    item->cfg.render_callback(item->cfg.userdata, item->computed_rect);
+    //---------------------------------------------------------------------------------------
+    // Walks the tree in the reverse of the order it's rendered in, so the first item that contains the point is the
+    // one drawn on top. Only the subtrees whose bounds contain the point are visited
+    id layout_t::private_t::item_at(float x, float y)
+    {
+        update_bounds(hit_bounds);
+        std::vector<hit_entry_t>& stack = scratch_[0].hit_stack;
+        layout_stats_t& stats = scratch_[0].stats;
+        stack.clear();
+        scratch_push(stack, hit_entry_t{render_state_t{layout_rect_}, 0}, stats);
+        while (!stack.empty()) {
+            const hit_entry_t entry = stack.back();
+            stack.pop_back();
+
+            const int item_id = entry.item_id;
+            const render_state_t& state = entry.state;
+            if (entry.children_done) {
+                if (contains(offset_rect(rects_[item_id], state.offset_x, state.offset_y), x, y)) {
+                    return item_id;
                 }
+                continue;
+            }
+            if (!contains(state.clip, x, y)
+                || !contains(offset_rect(bounds_[item_id], state.offset_x, state.offset_y), x, y)) {
+                continue;
+            }
 
-                layout_container(item->computed_rect.x, item->computed_rect.y, item);
-                ++j;
+            // The item is drawn before its children, so it's only hit if none of them are
+            if (item_id != 0) {
+                scratch_push(stack, hit_entry_t{state, item_id, true}, stats);
+            }
+
+            const item_cold_t& cold = cold_[item_id];
+            const render_state_t inner = {
+                cold.clip ? intersect(offset_rect(rects_[item_id], state.offset_x, state.offset_y), state.clip)
+                          : state.clip,
+                state.offset_x - cold.scroll_x,
+                state.offset_y - cold.scroll_y,
+            };
+            for (const int c : children_near(item_id, inner, rect_t{x, y}, hit_bounds)) {
+                scratch_push(stack, hit_entry_t{inner, c}, stats);
             }
-            ++i;
         }
+        return invalid_id;
     }
 
     //---------------------------------------------------------------------------------------
-    void layout_t::private_t::do_layout()
+    void layout_t::private_t::items_intersecting(const rect_t& area, std::vector<id>& items)
     {
-        // Add a scissor rect to disallow drawing outside the main layout
-        BeginScissorMode((int)layout_rect_.x, (int)layout_rect_.y, (int)layout_rect_.width, (int)layout_rect_.height);
-        layout_container(layout_rect_.x, layout_rect_.y, items_[0]);
-        EndScissorMode();
+        // The same walk as `render_tree`, but only into the subtrees whose bounds overlap the area
+        update_bounds(hit_bounds);
+        items.clear();
+        std::vector<hit_entry_t>& stack = scratch_[0].hit_stack;
+        layout_stats_t& stats = scratch_[0].stats;
+        stack.clear();
+        scratch_push(stack, hit_entry_t{render_state_t{layout_rect_}, 0}, stats);
+        while (!stack.empty()) {
+            const hit_entry_t entry = stack.back();
+            stack.pop_back();
+
+            const int item_id = entry.item_id;
+            const render_state_t& state = entry.state;
+            const rect_t& bounds = bounds_[item_id];
+            if (bounds.width <= 0 || bounds.height <= 0 || !overlaps(state.clip, area)
+                || !overlaps(offset_rect(bounds, state.offset_x, state.offset_y), area)) {
+                continue;
+            }
+
+            // Only the items `render_tree` draws are included, and not the ones without any visible area, which
+            // don't cover any part of the area even if they are drawn
+            const rect_t rect = offset_rect(rects_[item_id], state.offset_x, state.offset_y);
+            const rect_t visible = intersect(rect, state.clip);
+            if (item_id != 0 && overlaps(rect, state.clip) && visible.width > 0 && visible.height > 0
+                && overlaps(visible, area)) {
+                items.push_back(item_id);
+            }
+
+            // Only the part of the area inside the clip rect can overlap the visible part of a child
+            const item_cold_t& cold = cold_[item_id];
+            const render_state_t inner = {
+                cold.clip ? intersect(rect, state.clip) : state.clip,
+                state.offset_x - cold.scroll_x,
+                state.offset_y - cold.scroll_y,
+            };
+            if (!overlaps(inner.clip, area)) {
+                continue;
+            }
+            const std::span<const int> child_ids =
+                children_near(item_id, inner, intersect(area, inner.clip), hit_bounds);
+            for (size_t i = child_ids.size(); i > 0; --i) {
+                scratch_push(stack, hit_entry_t{inner, child_ids[i - 1]}, stats);
+            }
+        }
     }
 
     //---------------------------------------------------------------------------------------
-    Rectangle layout_t::private_t::get_rect_for_item(id item_id) const
+    layout_stats_t layout_t::private_t::get_stats() const
     {
-        assert(item_id >= 0);
-        assert(item_id < (int)items_.size());
+        layout_stats_t total;
+        for (const scratch_t& scratch : scratch_) {
+            const layout_stats_t& s = scratch.stats;
+            total.row_split_ns += s.row_split_ns;
+            total.flex_ns += s.flex_ns;
+            total.main_axis_ns += s.main_axis_ns;
+            total.cross_axis_ns += s.cross_axis_ns;
+            total.rect_ns += s.rect_ns;
+            total.render_callback_ns += s.render_callback_ns;
+            total.items_drawn += s.items_drawn;
+            total.items_culled += s.items_culled;
+            total.containers_visited += s.containers_visited;
+            total.containers_cached += s.containers_cached;
+            total.rows_created += s.rows_created;
+            total.items_wrapped += s.items_wrapped;
+            total.scratch_growths += s.scratch_growths;
+        }
+        return total;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::reset_stats()
+    {
+        for (scratch_t& scratch : scratch_) {
+            scratch.stats = {};
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    layout_capacity_t layout_t::private_t::get_capacity() const
+    {
+        layout_capacity_t capacity;
+        capacity.items = cfgs_.capacity();
+        capacity.child_index = child_index_.capacity();
+        capacity.config_stack = config_stack_.capacity();
+
+        auto bytes = [](const auto& vec) { return vec.capacity() * sizeof(vec[0]); };
+        for (const scratch_t& scratch : scratch_) {
+            capacity.scratch_bytes += bytes(scratch.item_base_sizes) + bytes(scratch.item_min_sizes)
+                                      + bytes(scratch.item_max_sizes) + bytes(scratch.item_flex_grow)
+                                      + bytes(scratch.item_flex_shrink) + bytes(scratch.item_main_axis_sizes)
+                                      + bytes(scratch.item_cross_axis_sizes) + bytes(scratch.item_start)
+                                      + bytes(scratch.rows) + bytes(scratch.row_sizes) + bytes(scratch.row_start)
+                                      + bytes(scratch.pending) + bytes(scratch.render_states) + bytes(scratch.hit_stack)
+                                      + bytes(scratch.scrolled_ancestors) + bytes(scratch.trace);
+        }
+        capacity.cache_bytes = bytes(cache_.cfgs) + bytes(cache_.nodes) + bytes(cache_.rects) + bytes(cache_.keys)
+                               + bytes(cache_.child_index) + bytes(cache_.table) + bytes(cache_.prev_ids);
+        capacity.list_bytes = bytes(lists_) + bytes(cache_.lists);
+        for (const virtual_list_t& list : lists_) {
+            capacity.list_bytes += bytes(list.row_starts);
+        }
+        for (const virtual_list_t& list : cache_.lists) {
+            capacity.list_bytes += bytes(list.row_starts);
+        }
+        capacity.total_bytes = bytes(cfgs_) + bytes(nodes_) + bytes(rects_) + bytes(cold_) + bytes(keys_)
+                               + bytes(child_index_) + bytes(bounds_) + bytes(sibling_extents_)
+                               + bytes(draw_bounds_) + bytes(draw_extents_) + bytes(config_stack_)
+                               + bytes(trace_depths_)
+                               + capacity.scratch_bytes + capacity.cache_bytes + capacity.list_bytes;
+        return capacity;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::set_tracing(bool enabled)
+    {
+        if (enabled && !tracing_ && trace_start_ns_ == 0) {
+            trace_start_ns_ = trace_clock_ns();
+        }
+        tracing_ = enabled;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::clear_trace()
+    {
+        for (scratch_t& scratch : scratch_) {
+            scratch.trace.clear();
+        }
+        trace_start_ns_ = tracing_ ? trace_clock_ns() : 0;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::update_trace_depths()
+    {
+        // Parents always have lower ids than their children, so the depths can be filled in front to back
+        trace_depths_.resize(nodes_.size());
+        trace_depths_[0] = 0;
+        for (size_t i = 1; i < nodes_.size(); ++i) {
+            trace_depths_[i] = trace_depths_[nodes_[i].parent] + 1;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::private_t::record_trace(scratch_t& scratch, trace_event_kind_t kind, int item_id, int64_t start_ns)
+    {
+        trace_event_t& event = scratch.trace.emplace_back();
+        event.kind = kind;
+        event.item_id = item_id;
+        event.child_count = nodes_[item_id].child_count;
+        event.depth = trace_depths_[item_id];
+        event.start_ns = start_ns;
+        event.duration_ns = trace_clock_ns() - start_ns;
+    }
 
-        if (item_id >= 0 && item_id < (int)items_.size()) {
-            return items_[item_id]->computed_rect;
+    //---------------------------------------------------------------------------------------
+    bool layout_t::private_t::write_trace(const char* path) const
+    {
+        FILE* f = fopen(path, "w");
+        if (!f) {
+            return false;
+        }
+
+        static const char* event_names[] = {"compute_layout", "render", "layout_container", "render_callback"};
+
+        // Complete ("X") events, one thread per worker, with the times in microseconds
+        fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+        const char* separator = "\n";
+        for (int worker = 0; const scratch_t& scratch : scratch_) {
+            for (const trace_event_t& event : scratch.trace) {
+                fprintf(
+                    f,
+                    "%s{\"name\":\"%s\",\"cat\":\"flexy\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"args\":{\"id\":%d,\"child_count\":%d,\"depth\":%d}}",
+                    separator,
+                    event_names[(int)event.kind],
+                    worker,
+                    (event.start_ns - trace_start_ns_) / 1000.0,
+                    event.duration_ns / 1000.0,
+                    event.item_id,
+                    event.child_count,
+                    event.depth);
+                separator = ",\n";
+            }
+            ++worker;
         }
-        return Rectangle{0, 0, 0, 0};
+        fprintf(f, "\n]}\n");
+
+        const bool write_error = ferror(f) != 0;
+        return fclose(f) == 0 && !write_error;
     }
 
     //=======================================================================================
-    layout_t::layout_t(const Rectangle& layout_rect) : p_(new private_t(layout_rect))
+    layout_t::layout_t(const rect_t& layout_rect) : p_(new private_t(layout_rect))
     {
     }
 
@@ -574,10 +2273,40 @@ namespace flexy {
         delete p_;
     }
 
+    //---------------------------------------------------------------------------------------
+    void layout_t::reset(const rect_t& layout_rect)
+    {
+        p_->reset(layout_rect);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_layout_cache(bool enabled)
+    {
+        p_->set_layout_cache(enabled);
+    }
+
     //---------------------------------------------------------------------------------------
     void layout_t::push_config(const add_item_cfg_t& cfg)
     {
-        p_->push_config(cfg);
+        p_->push_config(packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::push_config(add_item_cfg_t&& cfg)
+    {
+        p_->push_config(packed_cfg_t(std::move(cfg)));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::push_config(const packed_cfg_t& cfg)
+    {
+        p_->push_config(packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::push_config(packed_cfg_t&& cfg)
+    {
+        p_->push_config(std::move(cfg));
     }
 
     //---------------------------------------------------------------------------------------
@@ -589,27 +2318,276 @@ namespace flexy {
     //---------------------------------------------------------------------------------------
     id layout_t::add_item(const add_item_cfg_t& cfg)
     {
-        return p_->add_item(cfg);
+        return p_->add_item(packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_item(add_item_cfg_t&& cfg)
+    {
+        return p_->add_item(packed_cfg_t(std::move(cfg)));
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_item(const packed_cfg_t& cfg)
+    {
+        return p_->add_item(packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_item(packed_cfg_t&& cfg)
+    {
+        return p_->add_item(std::move(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_items(id parent_id, std::span<const add_item_cfg_t> cfgs)
+    {
+        return p_->add_items(parent_id, cfgs);
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_items(id parent_id, std::span<const packed_cfg_t> cfgs)
+    {
+        return p_->add_items(parent_id, cfgs);
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_items(
+        id parent_id,
+        int count,
+        const add_item_cfg_t& cfg,
+        std::span<const float> widths,
+        std::span<const float> heights)
+    {
+        return p_->add_items(parent_id, count, packed_cfg_t(cfg), widths, heights);
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_items(
+        id parent_id,
+        int count,
+        const packed_cfg_t& cfg,
+        std::span<const float> widths,
+        std::span<const float> heights)
+    {
+        return p_->add_items(parent_id, count, cfg, widths, heights);
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_virtual_list(const add_item_cfg_t& cfg, const virtual_list_cfg_t& list)
+    {
+        return p_->add_virtual_list(packed_cfg_t(cfg), list);
+    }
+
+    //---------------------------------------------------------------------------------------
+    id layout_t::add_virtual_list(const packed_cfg_t& cfg, const virtual_list_cfg_t& list)
+    {
+        return p_->add_virtual_list(packed_cfg_t(cfg), list);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::update_virtual_list(id item_id, const virtual_list_cfg_t& list, int first_changed_row)
+    {
+        p_->update_virtual_list(item_id, list, first_changed_row);
+    }
+
+    //---------------------------------------------------------------------------------------
+    virtual_range_t layout_t::get_virtual_list_range(id item_id) const
+    {
+        return p_->get_virtual_list_range(item_id);
+    }
+
+    //---------------------------------------------------------------------------------------
+    rect_t layout_t::get_virtual_list_row_rect(id item_id, int row)
+    {
+        return p_->get_virtual_list_row_rect(item_id, row);
+    }
+
+    //---------------------------------------------------------------------------------------
+    double layout_t::get_virtual_list_content_size(id item_id)
+    {
+        return p_->get_virtual_list_content_size(item_id);
     }
 
     //---------------------------------------------------------------------------------------
     void layout_t::do_layout()
     {
-        p_->do_layout();
+        p_->compute_layout();
+        p_->render();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::compute_layout()
+    {
+        p_->compute_layout();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::render()
+    {
+        p_->render();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::update_item(id item_id, const add_item_cfg_t& cfg)
+    {
+        p_->update_item(item_id, packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::update_item(id item_id, add_item_cfg_t&& cfg)
+    {
+        p_->update_item(item_id, packed_cfg_t(std::move(cfg)));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::update_item(id item_id, const packed_cfg_t& cfg)
+    {
+        p_->update_item(item_id, packed_cfg_t(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::update_item(id item_id, packed_cfg_t&& cfg)
+    {
+        p_->update_item(item_id, std::move(cfg));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_layout_rect(const rect_t& layout_rect)
+    {
+        p_->set_layout_rect(layout_rect);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_traversal_order(traversal_order_t order)
+    {
+        p_->set_traversal_order(order);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_thread_pool(thread_pool_t* pool, int min_parallel_items)
+    {
+        p_->set_thread_pool(pool, min_parallel_items);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_scissor_callbacks(begin_scissor_t begin, end_scissor_t end)
+    {
+        p_->set_scissor_callbacks(begin, end);
     }
 
     //---------------------------------------------------------------------------------------
-    Rectangle layout_t::get_rect_for_item(id item_id) const
+    rect_t layout_t::get_rect_for_item(id item_id) const
     {
         return p_->get_rect_for_item(item_id);
     }
 
+    //---------------------------------------------------------------------------------------
+    id layout_t::item_at(float x, float y)
+    {
+        return p_->item_at(x, y);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::items_intersecting(const rect_t& area, std::vector<id>& items)
+    {
+        p_->items_intersecting(area, items);
+    }
+
+    //---------------------------------------------------------------------------------------
+    rect_t layout_t::get_content_rect(id item_id)
+    {
+        return p_->get_content_rect(item_id);
+    }
+
+    //---------------------------------------------------------------------------------------
+    layout_stats_t layout_t::get_stats() const
+    {
+        return p_->get_stats();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::reset_stats()
+    {
+        p_->reset_stats();
+    }
+
+    //---------------------------------------------------------------------------------------
+    layout_capacity_t layout_t::get_capacity() const
+    {
+        return p_->get_capacity();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::set_tracing(bool enabled)
+    {
+        p_->set_tracing(enabled);
+    }
+
+    //---------------------------------------------------------------------------------------
+    bool layout_t::write_trace(const char* path) const
+    {
+        return p_->write_trace(path);
+    }
+
+    //---------------------------------------------------------------------------------------
+    void layout_t::clear_trace()
+    {
+        p_->clear_trace();
+    }
+
+    //=======================================================================================
+    packed_cfg_t::packed_cfg_t(const add_item_cfg_t& cfg) : packed_cfg_t(add_item_cfg_t(cfg))
+    {
+    }
+
+    //---------------------------------------------------------------------------------------
+    packed_cfg_t::packed_cfg_t(add_item_cfg_t&& cfg)
+    {
+#define PACK(x)                              \
+    if (cfg.x.has_value()) {                 \
+        values.x = std::move(cfg.x.value()); \
+        fields |= field_##x;                 \
+    }
+        PACK(parent_id);
+        PACK(width);
+        PACK(height);
+        PACK(min_width);
+        PACK(min_height);
+        PACK(max_width);
+        PACK(max_height);
+        PACK(flex_grow);
+        PACK(flex_shrink);
+        PACK(margin);
+        PACK(padding);
+        PACK(horizontal);
+        PACK(wrap);
+        PACK(container_alignment);
+        PACK(multi_row_alignment);
+        PACK(item_alignment);
+        PACK(userdata);
+        PACK(render_callback);
+        PACK(key);
+        PACK(clip);
+        PACK(scroll_x);
+        PACK(scroll_y);
+#undef PACK
+        values.merge_config = cfg.merge_config;
+        values.use_config_stack = cfg.use_config_stack;
+    }
+
     //=======================================================================================
     scoped_config_t::scoped_config_t(const add_item_cfg_t& cfg, layout_t* layout) : layout(layout)
     {
         layout->push_config(cfg);
     }
 
+    //---------------------------------------------------------------------------------------
+    scoped_config_t::scoped_config_t(const packed_cfg_t& cfg, layout_t* layout) : layout(layout)
+    {
+        layout->push_config(cfg);
+    }
+
     //---------------------------------------------------------------------------------------
     scoped_config_t::~scoped_config_t()
     {
@@ -1,16 +1,26 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
-#include <functional>
+#include <string.h>
+#include <new>
 #include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-struct Rectangle;
+// The size of the inline storage in render_callback_t. Lambdas with larger captures don't compile, so either raise
+// this, or pass the state through the item's userdata instead
+#ifndef FLEXY_CALLBACK_STORAGE
+#define FLEXY_CALLBACK_STORAGE 32
+#endif
 
 // Based on flexbox, but simplified
 namespace flexy {
 
     // Used to lay out items and rows in a container
-    enum class container_alignment_t {
+    enum class container_alignment_t : uint8_t {
         start,
         end,
         center,
@@ -21,7 +31,7 @@ namespace flexy {
     };
 
     // Used to lay out individual items
-    enum class item_alignment_t {
+    enum class item_alignment_t : uint8_t {
         start,
         end,
         center,
@@ -46,29 +56,361 @@ namespace flexy {
         float left = 0;
     };
 
+    // Aligned so it can be loaded into a single SIMD register. The raylib adapter (flexy_raylib.hpp) converts it
+    // to and from raylib's Rectangle
+    struct alignas(16) rect_t
+    {
+        float x = 0;
+        float y = 0;
+        float width = 0;
+        float height = 0;
+    };
+
+    // The order containers are visited in by `compute_layout`. Both give the same result, but depending on how the
+    // tree was built, one of them may access memory more sequentially
+    enum class traversal_order_t : uint8_t {
+        depth_first,
+        breadth_first,
+    };
+
+    // Counters and timers collected when the layout is built with FLEXY_STATS=1. They add up over every call to
+    // `compute_layout` and `render`, until `reset_stats` is called. Without FLEXY_STATS they're always 0, and the
+    // instrumentation compiles to nothing
+    struct layout_stats_t
+    {
+        // Time spent in each phase of laying out a container, in nanoseconds
+        int64_t row_split_ns = 0;
+        int64_t flex_ns = 0;        // Resolving flex grow/shrink
+        int64_t main_axis_ns = 0;   // Positioning the items within each row
+        int64_t cross_axis_ns = 0;  // Positioning the rows
+        int64_t rect_ns = 0;        // Writing out the item rects
+        int64_t render_callback_ns = 0;
+
+        int64_t items_drawn = 0;   // Render callbacks that were called
+        int64_t items_culled = 0;  // Items skipped by `render` for being outside the clip rect
+
+        int64_t containers_visited = 0;
+        int64_t containers_cached = 0;  // Containers that were unchanged since the previous frame
+        int64_t rows_created = 0;
+        int64_t items_wrapped = 0;    // Items that started a new row
+        int64_t scratch_growths = 0;  // Times a scratch buffer had to grow. Other allocations aren't counted
+    };
+
+    // The storage held by a layout, as returned by `layout_t::get_capacity`. All of it is kept by `layout_t::reset`,
+    // except for the row sizes measured by virtual lists
+    struct layout_capacity_t
+    {
+        size_t items = 0;          // Items that fit before the item storage has to grow
+        size_t child_index = 0;    // Entries in the child index
+        size_t config_stack = 0;   // Configs that fit on the config stack
+        size_t scratch_bytes = 0;  // The buffers used while laying out and rendering, summed over all the threads
+        size_t cache_bytes = 0;    // The previous frame's tree, kept when the layout cache is enabled
+        size_t list_bytes = 0;     // The virtual lists, and the row sizes they have measured
+        size_t total_bytes = 0;    // Everything above, in bytes
+    };
+
+    // The rows of a virtual list, see `layout_t::add_virtual_list`
+    struct virtual_list_cfg_t
+    {
+        int count = 0;       // Number of rows
+        float row_size = 0;  // The size of every row along the list, unless there's a `row_size_callback`
+
+        // Returns the size of a row along the list. The rows are measured once, in order, and only as far as the
+        // list has been scrolled, and their start positions are kept so finding a row is a binary search
+        float (*row_size_callback)(void* userdata, int row) = nullptr;
+
+        void (*render_row)(void* userdata, int row, const rect_t& rect) = nullptr;
+        void* userdata = nullptr;  // Passed to the callbacks
+
+        int overscan = 2;  // Rows materialized on each side of the visible ones
+
+        // How far the list has been scrolled from its first row. A double, as a float can't place rows exactly
+        // once the list is a few million pixels long
+        double scroll = 0;
+    };
+
+    // A range of rows in a virtual list
+    struct virtual_range_t
+    {
+        int first = 0;
+        int count = 0;
+    };
+
     using id = int32_t;
 
     //=======================================================================================
     struct add_item_cfg_t;
+    struct packed_cfg_t;
+    struct thread_pool_t;
     struct layout_t
     {
-        layout_t(const Rectangle& layout_rect);
+        layout_t(const rect_t& layout_rect);
         ~layout_t();
 
+        // Removes all the items and configs, to build a new tree in the same layout. All the storage is kept, so
+        // rebuilding a tree of about the same size every frame doesn't allocate. The settings (traversal order,
+        // thread pool, scissor callbacks, tracing) and the stats are kept as well
+        void reset(const rect_t& layout_rect);
+
+        // With the layout cache enabled, `reset` keeps the tree from the previous frame, and the next
+        // `compute_layout` reconciles the new tree with it. Each item gets a stable key, made from its parent's key
+        // and either its own `key` or its position among its siblings, and the children of each item are matched
+        // with last frame's children by position, or by key when the siblings have changed. Matched items keep
+        // their rects from last frame, and only the containers whose position, config, children, or children's
+        // configs have changed are laid out again. The result is always the same as laying out the whole tree.
+        // This doubles the storage used by the layout.
+        void set_layout_cache(bool enabled);
+
+        // The rvalue versions move the config, including the render callback, into the layout instead of copying it
         void push_config(const add_item_cfg_t& cfg);
+        void push_config(add_item_cfg_t&& cfg);
+        void push_config(const packed_cfg_t& cfg);
+        void push_config(packed_cfg_t&& cfg);
         void pop_config();
 
         id add_item(const add_item_cfg_t& cfg);
+        id add_item(add_item_cfg_t&& cfg);
+        id add_item(const packed_cfg_t& cfg);
+        id add_item(packed_cfg_t&& cfg);
+
+        // Adds a child to `parent_id` for each config, in one go. This is cheaper than calling `add_item` for each of
+        // them, as the storage is reserved once and the config stack is only looked up once. The items get
+        // consecutive ids, and the id of the first one is returned. The `parent_id` set in the configs is ignored.
+        id add_items(id parent_id, std::span<const add_item_cfg_t> cfgs);
+        id add_items(id parent_id, std::span<const packed_cfg_t> cfgs);
+
+        // Adds `count` children to `parent_id` that all use `cfg`, which is only resolved once. If `widths` or
+        // `heights` aren't empty, they hold the width or height of each item, overriding the one in `cfg`
+        id add_items(
+            id parent_id,
+            int count,
+            const add_item_cfg_t& cfg,
+            std::span<const float> widths = {},
+            std::span<const float> heights = {});
+        id add_items(
+            id parent_id,
+            int count,
+            const packed_cfg_t& cfg,
+            std::span<const float> widths = {},
+            std::span<const float> heights = {});
+
+        // Adds a virtual list. It's laid out in its parent like any other item, but instead of having children, it
+        // holds `list.count` rows, that are placed along its main axis, scrolled by `list.scroll`, and fill its rect
+        // across. `compute_layout` only finds the rows that are within the layout rect, plus `list.overscan` on
+        // each side, and `render` only calls `list.render_row` for those of them that are visible, clipped to the
+        // item's rect. So the cost per frame depends on the rows that are visible, not on the length of the list.
+        // With the layout cache enabled, a list that has the same key, `row_size_callback` and userdata as in the
+        // previous frame keeps the row sizes it has measured. A virtual list can't have any children
+        id add_virtual_list(const add_item_cfg_t& cfg, const virtual_list_cfg_t& list);
+        id add_virtual_list(const packed_cfg_t& cfg, const virtual_list_cfg_t& list);
+
+        // Replaces the rows of a list, eg to scroll it. The sizes measured for the rows before `first_changed_row`
+        // are kept, so pass 0 if `row_size_callback` or its userdata have changed
+        void update_virtual_list(id item_id, const virtual_list_cfg_t& list, int first_changed_row);
+
+        // The rows materialized by the last `compute_layout`
+        virtual_range_t get_virtual_list_range(id item_id) const;
+
+        // Measures the rows up to `row`, if there's a `row_size_callback`. The content size measures all of them
+        rect_t get_virtual_list_row_rect(id item_id, int row);
+        double get_virtual_list_content_size(id item_id);
+
+        // `do_layout` is the same as `compute_layout` followed by `render`. `compute_layout` only calculates the
+        // item rectangles, and doesn't call any render callbacks.
         void do_layout();
+        void compute_layout();
+        void render();
+
+        // Retained mode: the layout can be kept alive between frames, and items can be modified in place. Only
+        // the containers affected by a change are laid out again on the next call to `compute_layout`, along with
+        // the containers they move, so the rects are always the same as a fresh layout of the tree.
+        // Note, `update_item` only applies the fields that are set in `cfg`, and ignores the config stack.
+        void update_item(id item_id, const add_item_cfg_t& cfg);
+        void update_item(id item_id, add_item_cfg_t&& cfg);
+        void update_item(id item_id, const packed_cfg_t& cfg);
+        void update_item(id item_id, packed_cfg_t&& cfg);
+        void set_layout_rect(const rect_t& layout_rect);
+        void set_traversal_order(traversal_order_t order);
+
+        // Lays out independent subtrees in parallel on `pool`. Only subtrees with at least `min_parallel_items` items
+        // are handed to the pool, smaller ones are laid out by the thread that reached them. Pass nullptr to go
+        // back to laying out everything on the calling thread. The stats and trace events collected by each worker are
+        // kept when the pool is changed.
+        void set_thread_pool(thread_pool_t* pool, int min_parallel_items = 4096);
+
+        // Called by `render` to clip the rendering to the layout rect, and to the rects of items with `clip` set.
+        // When a clipping item is done, `begin` is called again with the outer clip rect, so it has to replace the
+        // current scissor rect rather than nest. The layout itself doesn't depend on any graphics library, see
+        // flexy_raylib.hpp for the raylib version
+        using begin_scissor_t = void (*)(const rect_t& rect);
+        using end_scissor_t = void (*)();
+        void set_scissor_callbacks(begin_scissor_t begin, end_scissor_t end);
+
+        // Where the item is rendered, ie its rect moved by the scroll offsets of its ancestors. Once any item is
+        // scrolled, this uses the layout's scratch buffers, so it can't be called from several threads at once
+        rect_t get_rect_for_item(id item_id) const;
+
+        // Hit testing, against the items as they're rendered: moved by the scroll offsets of their ancestors, and
+        // clipped to the layout rect and to their clipping ancestors. The bounds of each subtree are kept between
+        // calls, and only the subtrees that could contain the point or area are visited, so a query only looks at
+        // the items near it, plus their ancestors. After the layout changes, the first query updates the bounds of
+        // the parts that changed. Call these after `compute_layout`
+        //
+        // `item_at` returns the item that is drawn on top at (x, y), or -1 if there is none. `items_intersecting`
+        // replaces the contents of `items` with the items that overlap `area`, in the order they're rendered.
+        // Items without a render callback can be hit as well. The rows of a virtual list aren't items, so they hit
+        // the list itself, and `get_virtual_list_row_rect` can be used to find the row
+        id item_at(float x, float y);
+        void items_intersecting(const rect_t& area, std::vector<id>& items);
+
+        // The area covered by the children of the item, including their padding and margins, relative to the
+        // item's rect, and without its own scroll offset. So a scroll container that has its content starting at 0
+        // can be scrolled from 0 to `content.width - rect.width`
+        rect_t get_content_rect(id item_id);
+
+        layout_stats_t get_stats() const;
+        void reset_stats();
+        layout_capacity_t get_capacity() const;
 
-        Rectangle get_rect_for_item(id item_id) const;
+        // While tracing is enabled, every `compute_layout` and `render` call, every container laid out, and every
+        // render callback is recorded. `write_trace` saves the recorded events as Chrome trace event JSON, which
+        // can be opened in chrome://tracing or Perfetto. Returns false if the file couldn't be written
+        void set_tracing(bool enabled);
+        bool write_trace(const char* path) const;
+        void clear_trace();
 
         struct private_t;
         private_t* p_ = nullptr;
     };
 
     //=======================================================================================
-    using render_callback_t = std::function<void(void* userdata, const Rectangle& rect)>;
+    // Holds the function called to render an item. Works like a std::function, but the callable is always stored
+    // inline, so creating, copying and calling it never allocates. Calling it is a single indirect call.
+    struct render_callback_t
+    {
+        render_callback_t() = default;
+
+        template <typename F>
+            requires(!std::is_same_v<std::decay_t<F>, render_callback_t>
+                     && std::is_invocable_r_v<void, std::decay_t<F>&, void*, const rect_t&>)
+        render_callback_t(F&& f)
+        {
+            using callable_t = std::decay_t<F>;
+            static_assert(
+                sizeof(callable_t) <= FLEXY_CALLBACK_STORAGE,
+                "The render callback is too large to be stored inline, see FLEXY_CALLBACK_STORAGE");
+            static_assert(alignof(callable_t) <= alignof(max_align_t));
+
+            // A null function pointer gives an empty callback
+            if constexpr (std::is_pointer_v<std::remove_cvref_t<F>>) {
+                if (!f) {
+                    return;
+                }
+            }
+
+            new (storage_) callable_t(std::forward<F>(f));
+            invoke_ = [](void* storage, void* userdata, const rect_t& rect) {
+                (*(callable_t*)storage)(userdata, rect);
+            };
+
+            // Most callbacks only capture plain values, and can be copied with a memcpy
+            if constexpr (!std::is_trivially_copyable_v<callable_t>) {
+                static constexpr ops_t ops = {
+                    .copy = [](void* dst, const void* src) { new (dst) callable_t(*(const callable_t*)src); },
+                    .move = [](void* dst, void* src) { new (dst) callable_t(std::move(*(callable_t*)src)); },
+                    .destroy = [](void* storage) { ((callable_t*)storage)->~callable_t(); },
+                };
+                ops_ = &ops;
+            }
+        }
+
+        render_callback_t(const render_callback_t& other)
+        {
+            copy_from(other);
+        }
+
+        render_callback_t(render_callback_t&& other) noexcept
+        {
+            move_from(other);
+        }
+
+        render_callback_t& operator=(const render_callback_t& other)
+        {
+            if (this != &other) {
+                reset();
+                copy_from(other);
+            }
+            return *this;
+        }
+
+        render_callback_t& operator=(render_callback_t&& other) noexcept
+        {
+            if (this != &other) {
+                reset();
+                move_from(other);
+            }
+            return *this;
+        }
+
+        ~render_callback_t()
+        {
+            reset();
+        }
+
+        explicit operator bool() const
+        {
+            return invoke_ != nullptr;
+        }
+
+        void operator()(void* userdata, const rect_t& rect) const
+        {
+            invoke_((void*)storage_, userdata, rect);
+        }
+
+        void reset()
+        {
+            if (ops_) {
+                ops_->destroy(storage_);
+            }
+            invoke_ = nullptr;
+            ops_ = nullptr;
+        }
+
+        // Only needed for callables that aren't trivially copyable
+        struct ops_t
+        {
+            void (*copy)(void* dst, const void* src);
+            void (*move)(void* dst, void* src);
+            void (*destroy)(void* storage);
+        };
+
+        void copy_from(const render_callback_t& other)
+        {
+            if (other.ops_) {
+                other.ops_->copy(storage_, other.storage_);
+            } else {
+                memcpy(storage_, other.storage_, sizeof(storage_));
+            }
+            invoke_ = other.invoke_;
+            ops_ = other.ops_;
+        }
+
+        void move_from(render_callback_t& other)
+        {
+            if (other.ops_) {
+                other.ops_->move(storage_, other.storage_);
+            } else {
+                memcpy(storage_, other.storage_, sizeof(storage_));
+            }
+            invoke_ = other.invoke_;
+            ops_ = other.ops_;
+            other.reset();
+        }
+
+        alignas(max_align_t) unsigned char storage_[FLEXY_CALLBACK_STORAGE];
+        void (*invoke_)(void* storage, void* userdata, const rect_t& rect) = nullptr;
+        const ops_t* ops_ = nullptr;
+    };
 
     // Configuration when adding a new item
     struct add_item_cfg_t
@@ -99,14 +441,179 @@ namespace flexy {
         std::optional<void*> userdata;  // Passed as part of the render_callback
         std::optional<render_callback_t> render_callback;
 
+        // Clip the rendering of the children to the item's rect. Items that are outside the layout rect, or outside
+        // the rect of a clipping ancestor, aren't rendered, and the children of a clipping item that is outside are
+        // skipped altogether. The children of a clipping item whose subtrees can reach the clip rect are found with
+        // a binary search, so the others aren't visited, and anything that overflows a child into view is still
+        // drawn. Doesn't affect the layout
+        std::optional<bool> clip;
+
+        // Moves the children of the item by -scroll_x, -scroll_y when they're rendered, to scroll them. Like `clip`,
+        // this doesn't affect the layout, so scrolling only costs a render. Usually used together with `clip`
+        std::optional<float> scroll_x;
+        std::optional<float> scroll_y;
+
+        // Identifies the item among its siblings across frames, see `layout_t::set_layout_cache`. Items without a
+        // key are identified by their position among their siblings. Isn't taken from the config stack
+        std::optional<uint64_t> key;
+
         bool merge_config = true;      // If pushing a config, should this be merged with the existing config?
         bool use_config_stack = true;  // Should we use the existing config stack, or only use the given config?
     };
 
+    //=======================================================================================
+    // One bit for each field of a config
+    enum cfg_field_t : uint32_t {
+        field_parent_id = 1u << 0,
+        field_width = 1u << 1,
+        field_height = 1u << 2,
+        field_min_width = 1u << 3,
+        field_min_height = 1u << 4,
+        field_max_width = 1u << 5,
+        field_max_height = 1u << 6,
+        field_flex_grow = 1u << 7,
+        field_flex_shrink = 1u << 8,
+        field_margin = 1u << 9,
+        field_padding = 1u << 10,
+        field_horizontal = 1u << 11,
+        field_wrap = 1u << 12,
+        field_container_alignment = 1u << 13,
+        field_multi_row_alignment = 1u << 14,
+        field_item_alignment = 1u << 15,
+        field_userdata = 1u << 16,
+        field_render_callback = 1u << 17,
+        field_key = 1u << 18,
+        field_clip = 1u << 19,
+        field_scroll_x = 1u << 20,
+        field_scroll_y = 1u << 21,
+    };
+
+    // A compact version of add_item_cfg_t. Instead of each value being a std::optional, `fields` has a bit set for
+    // each value that has been set. Each setter sets a value and its bit, so a config can be built in one expression:
+    //
+    //   layout.add_item(flexy::cfg().parent_id(c0).width(90.f).height(60.f).flex_grow(1));
+    //
+    // An add_item_cfg_t converts to a packed_cfg_t, and everything the layout does with a config is done in this form
+    struct packed_cfg_t
+    {
+        packed_cfg_t(const add_item_cfg_t& cfg);
+        packed_cfg_t(add_item_cfg_t&& cfg);
+
+#define FLEXY_PACKED_SETTER(type, x) \
+    packed_cfg_t& x(type value)      \
+    {                                \
+        values.x = std::move(value); \
+        fields |= field_##x;         \
+        return *this;                \
+    }
+        FLEXY_PACKED_SETTER(int, parent_id)
+        FLEXY_PACKED_SETTER(float, width)
+        FLEXY_PACKED_SETTER(float, height)
+        FLEXY_PACKED_SETTER(float, min_width)
+        FLEXY_PACKED_SETTER(float, min_height)
+        FLEXY_PACKED_SETTER(float, max_width)
+        FLEXY_PACKED_SETTER(float, max_height)
+        FLEXY_PACKED_SETTER(int, flex_grow)
+        FLEXY_PACKED_SETTER(int, flex_shrink)
+        FLEXY_PACKED_SETTER(margin_t, margin)
+        FLEXY_PACKED_SETTER(padding_t, padding)
+        FLEXY_PACKED_SETTER(bool, horizontal)
+        FLEXY_PACKED_SETTER(bool, wrap)
+        FLEXY_PACKED_SETTER(container_alignment_t, container_alignment)
+        FLEXY_PACKED_SETTER(container_alignment_t, multi_row_alignment)
+        FLEXY_PACKED_SETTER(item_alignment_t, item_alignment)
+        FLEXY_PACKED_SETTER(void*, userdata)
+        FLEXY_PACKED_SETTER(render_callback_t, render_callback)
+        FLEXY_PACKED_SETTER(uint64_t, key)
+        FLEXY_PACKED_SETTER(bool, clip)
+        FLEXY_PACKED_SETTER(float, scroll_x)
+        FLEXY_PACKED_SETTER(float, scroll_y)
+#undef FLEXY_PACKED_SETTER
+
+        packed_cfg_t& merge_config(bool value)
+        {
+            values.merge_config = value;
+            return *this;
+        }
+
+        packed_cfg_t& use_config_stack(bool value)
+        {
+            values.use_config_stack = value;
+            return *this;
+        }
+
+        // Only the values that have their bit set in `fields` are used
+        struct values_t
+        {
+            int parent_id = 0;
+            float width = 0;
+            float height = 0;
+            float min_width = 0;
+            float min_height = 0;
+            float max_width = 0;
+            float max_height = 0;
+            float scroll_x = 0;
+            float scroll_y = 0;
+            int flex_grow = 0;
+            int flex_shrink = 0;
+            margin_t margin;
+            padding_t padding;
+            void* userdata = nullptr;
+            render_callback_t render_callback;
+            uint64_t key = 0;
+            bool horizontal = false;
+            bool wrap = false;
+            bool clip = false;
+            container_alignment_t container_alignment = container_alignment_t::start;
+            container_alignment_t multi_row_alignment = container_alignment_t::start;
+            item_alignment_t item_alignment = item_alignment_t::start;
+            bool merge_config = true;
+            bool use_config_stack = true;
+        };
+
+        values_t values;
+        uint32_t fields = 0;
+
+      private:
+        // There's no default constructor, so `add_item({})` still picks add_item_cfg_t. Use `flexy::cfg()` instead
+        struct empty_t
+        {
+        };
+        explicit packed_cfg_t(empty_t)
+        {
+        }
+        friend packed_cfg_t cfg();
+    };
+
+    // Starts a new packed config, with no fields set
+    inline packed_cfg_t cfg()
+    {
+        return packed_cfg_t(packed_cfg_t::empty_t{});
+    }
+
+    //---------------------------------------------------------------------------------------
+    // Helpers to make item keys from strings and pointers, like the ids in Dear ImGui. The key only has to be unique
+    // among the item's siblings, as it's combined with the key of the parent
+    inline uint64_t make_key(const char* str)
+    {
+        // FNV-1a
+        uint64_t key = 0xcbf29ce484222325ull;
+        for (; *str; ++str) {
+            key = (key ^ (unsigned char)*str) * 0x100000001b3ull;
+        }
+        return key;
+    }
+
+    inline uint64_t make_key(const void* ptr)
+    {
+        return (uint64_t)(uintptr_t)ptr;
+    }
+
     //=======================================================================================
     struct scoped_config_t
     {
         scoped_config_t(const add_item_cfg_t& cfg, layout_t* layout);
+        scoped_config_t(const packed_cfg_t& cfg, layout_t* layout);
         ~scoped_config_t();
 
         layout_t* layout;
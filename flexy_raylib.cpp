@@ -0,0 +1,25 @@
+#include "flexy_raylib.hpp"
+
+namespace flexy {
+
+    namespace {
+        //---------------------------------------------------------------------------------------
+        void begin_scissor(const rect_t& rect)
+        {
+            BeginScissorMode((int)rect.x, (int)rect.y, (int)rect.width, (int)rect.height);
+        }
+
+        //---------------------------------------------------------------------------------------
+        void end_scissor()
+        {
+            EndScissorMode();
+        }
+    }  // namespace
+
+    //---------------------------------------------------------------------------------------
+    void use_raylib_scissor(layout_t& layout)
+    {
+        layout.set_scissor_callbacks(begin_scissor, end_scissor);
+    }
+
+}  // namespace flexy
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <raylib.h>
+
+#include "flexy_layout.hpp"
+
+// Optional raylib adapter. The layout core doesn't depend on raylib, so this is only needed when rendering with it
+namespace flexy {
+
+    //---------------------------------------------------------------------------------------
+    inline Rectangle to_rectangle(const rect_t& rect)
+    {
+        return Rectangle{rect.x, rect.y, rect.width, rect.height};
+    }
+
+    //---------------------------------------------------------------------------------------
+    inline rect_t to_rect(const Rectangle& rect)
+    {
+        return rect_t{rect.x, rect.y, rect.width, rect.height};
+    }
+
+    // Clips the rendering of `layout` to its layout rect, and to the rects of clipping items, using raylib's scissor
+    // mode
+    void use_raylib_scissor(layout_t& layout);
+
+}  // namespace flexy
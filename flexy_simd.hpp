@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stddef.h>
+
+// Kernels used by the layout for the per-item loops over a row. Define FLEXY_NO_SIMD to force the scalar versions.
+//
+// The prefix sums are done in blocks of 4 lanes, and the scalar version emulates the exact same order of operations,
+// so the scalar, SSE2 and AVX2 versions all give bit-identical results. Compared to adding the values one after
+// another, the positions can differ in the last bits, due to the different rounding.
+// (This assumes the compiler isn't allowed to contract multiplies and adds into FMA instructions)
+//
+// Note, the row totals aren't calculated here. They are compared against the container size to decide whether to
+// grow/shrink a row, and a shrunk row often ends up at exactly that size, so they are still summed sequentially.
+// Rounding them differently would change which rows get grown.
+#if !defined(FLEXY_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define FLEXY_SSE2 1
+#include <emmintrin.h>
+#if defined(__AVX2__)
+#define FLEXY_AVX2 1
+#include <immintrin.h>
+#endif
+#endif
+
+namespace flexy::simd {
+
+#if FLEXY_SSE2
+    //---------------------------------------------------------------------------------------
+    // Loads the last 0-3 values, padding with zeros
+    inline __m128 load_tail(const float* values, size_t count)
+    {
+        float tmp[4] = {0, 0, 0, 0};
+        for (size_t i = 0; i < count; ++i) {
+            tmp[i] = values[i];
+        }
+        return _mm_loadu_ps(tmp);
+    }
+#endif
+
+    //---------------------------------------------------------------------------------------
+    // sizes[i] = max(min_sizes[i], base_sizes[i] - (base_sizes[i] * shrink[i] / total_shrink_scaled) * delta)
+    inline void flex_shrink(
+        const float* base_sizes,
+        const float* shrink,
+        const float* min_sizes,
+        float total_shrink_scaled,
+        float delta,
+        size_t count,
+        float* sizes)
+    {
+        size_t i = 0;
+#if FLEXY_AVX2
+        const __m256 total8 = _mm256_set1_ps(total_shrink_scaled);
+        const __m256 delta8 = _mm256_set1_ps(delta);
+        for (; i + 8 <= count; i += 8) {
+            __m256 base = _mm256_loadu_ps(base_sizes + i);
+            __m256 ratio = _mm256_div_ps(_mm256_mul_ps(base, _mm256_loadu_ps(shrink + i)), total8);
+            __m256 sz = _mm256_sub_ps(base, _mm256_mul_ps(ratio, delta8));
+            _mm256_storeu_ps(sizes + i, _mm256_max_ps(_mm256_loadu_ps(min_sizes + i), sz));
+        }
+#endif
+#if FLEXY_SSE2
+        const __m128 total4 = _mm_set1_ps(total_shrink_scaled);
+        const __m128 delta4 = _mm_set1_ps(delta);
+        for (; i + 4 <= count; i += 4) {
+            __m128 base = _mm_loadu_ps(base_sizes + i);
+            __m128 ratio = _mm_div_ps(_mm_mul_ps(base, _mm_loadu_ps(shrink + i)), total4);
+            __m128 sz = _mm_sub_ps(base, _mm_mul_ps(ratio, delta4));
+            _mm_storeu_ps(sizes + i, _mm_max_ps(_mm_loadu_ps(min_sizes + i), sz));
+        }
+#endif
+        for (; i < count; ++i) {
+            float ratio = base_sizes[i] * shrink[i] / total_shrink_scaled;
+            float sz = base_sizes[i] - ratio * delta;
+            sizes[i] = min_sizes[i] > sz ? min_sizes[i] : sz;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    // sizes[i] = min(max_sizes[i], base_sizes[i] + delta * grow[i] / grow_count)
+    inline void flex_grow(
+        const float* base_sizes,
+        const float* grow,
+        const float* max_sizes,
+        float delta,
+        float grow_count,
+        size_t count,
+        float* sizes)
+    {
+        size_t i = 0;
+#if FLEXY_AVX2
+        const __m256 delta8 = _mm256_set1_ps(delta);
+        const __m256 count8 = _mm256_set1_ps(grow_count);
+        for (; i + 8 <= count; i += 8) {
+            __m256 inc = _mm256_div_ps(_mm256_mul_ps(delta8, _mm256_loadu_ps(grow + i)), count8);
+            __m256 sz = _mm256_add_ps(_mm256_loadu_ps(base_sizes + i), inc);
+            _mm256_storeu_ps(sizes + i, _mm256_min_ps(_mm256_loadu_ps(max_sizes + i), sz));
+        }
+#endif
+#if FLEXY_SSE2
+        const __m128 delta4 = _mm_set1_ps(delta);
+        const __m128 count4 = _mm_set1_ps(grow_count);
+        for (; i + 4 <= count; i += 4) {
+            __m128 inc = _mm_div_ps(_mm_mul_ps(delta4, _mm_loadu_ps(grow + i)), count4);
+            __m128 sz = _mm_add_ps(_mm_loadu_ps(base_sizes + i), inc);
+            _mm_storeu_ps(sizes + i, _mm_min_ps(_mm_loadu_ps(max_sizes + i), sz));
+        }
+#endif
+        for (; i < count; ++i) {
+            float sz = base_sizes[i] + delta * grow[i] / grow_count;
+            sizes[i] = max_sizes[i] < sz ? max_sizes[i] : sz;
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    // positions[i] = start + sum(sizes[j] + spacing) for j < i
+    inline void prefix_positions(const float* sizes, size_t count, float start, float spacing, float* positions)
+    {
+#if FLEXY_SSE2
+        const __m128 spacing4 = _mm_set1_ps(spacing);
+        __m128 carry = _mm_set1_ps(start);
+        for (size_t i = 0; i < count; i += 4) {
+            const size_t n = count - i < 4 ? count - i : 4;
+            __m128 x = _mm_add_ps(n == 4 ? _mm_loadu_ps(sizes + i) : load_tail(sizes + i, n), spacing4);
+
+            // Inclusive scan of the 4 lanes, followed by a shift to make it exclusive
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+            __m128 pos = _mm_add_ps(carry, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+            carry = _mm_add_ps(carry, _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3)));
+
+            if (n == 4) {
+                _mm_storeu_ps(positions + i, pos);
+            } else {
+                float tmp[4];
+                _mm_storeu_ps(tmp, pos);
+                for (size_t j = 0; j < n; ++j) {
+                    positions[i + j] = tmp[j];
+                }
+            }
+        }
+#else
+        float carry = start;
+        for (size_t i = 0; i < count; i += 4) {
+            const size_t n = count - i < 4 ? count - i : 4;
+            float x[4] = {0, 0, 0, 0};
+            for (size_t j = 0; j < n; ++j) {
+                x[j] = sizes[i + j];
+            }
+            for (size_t j = 0; j < 4; ++j) {
+                x[j] += spacing;
+            }
+
+            // Same order of operations as the SSE2 version
+            const float t[4] = {x[0] + 0.f, x[1] + x[0], x[2] + x[1], x[3] + x[2]};
+            const float u[4] = {t[0] + 0.f, t[1] + 0.f, t[2] + t[0], t[3] + t[1]};
+            const float pos[4] = {carry + 0.f, carry + u[0], carry + u[1], carry + u[2]};
+            carry = carry + u[3];
+
+            for (size_t j = 0; j < n; ++j) {
+                positions[i + j] = pos[j];
+            }
+        }
+#endif
+    }
+
+}  // namespace flexy::simd
@@ -0,0 +1,247 @@
+#include "flexy_thread_pool.hpp"
+
+#include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace flexy {
+
+    //=======================================================================================
+    struct thread_pool_t::private_t
+    {
+        private_t(int worker_count);
+        ~private_t();
+
+        void submit(task_t&& task);
+        void wait();
+
+        bool try_run_task(int worker_index);
+        void worker_loop(int worker_index);
+        int current_worker_index() const;
+
+        // The tasks from `head` to the end are waiting. The front is only cleared once the queue is empty, so the
+        // storage is kept, and submitting tasks doesn't allocate once the queues have grown
+        struct worker_queue_t
+        {
+            std::mutex mutex;
+            std::vector<task_t> tasks;
+            size_t head = 0;
+        };
+
+        std::vector<std::unique_ptr<worker_queue_t>> queues_;
+        std::vector<std::thread> threads_;
+
+        std::atomic<int> unfinished_tasks_ = 0;  // Tasks that have been submitted, but haven't finished running
+        std::atomic<int> queued_tasks_ = 0;      // Tasks that are waiting in a queue
+        std::atomic<bool> quit_ = false;
+
+        // Workers without anything to do sleep here until a task is submitted, and `wait` sleeps here until a task is
+        // submitted or all of them are done
+        std::mutex sleep_mutex_;
+        std::condition_variable sleep_cv_;
+    };
+
+    namespace {
+        constexpr size_t initial_queue_capacity = 256;
+
+        // Lets `submit` find the queue of the worker it's called from
+        thread_local const thread_pool_t::private_t* tls_pool = nullptr;
+        thread_local int tls_worker_index = 0;
+    }  // namespace
+
+    //---------------------------------------------------------------------------------------
+    thread_pool_t::private_t::private_t(int worker_count)
+    {
+        if (worker_count <= 0) {
+            worker_count = (int)std::thread::hardware_concurrency();
+        }
+        worker_count = worker_count < 1 ? 1 : worker_count;
+
+        for (int i = 0; i < worker_count; ++i) {
+            queues_.push_back(std::make_unique<worker_queue_t>());
+            queues_.back()->tasks.reserve(initial_queue_capacity);
+        }
+
+        // Worker 0 is the thread calling `wait`
+        for (int i = 1; i < worker_count; ++i) {
+            threads_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    thread_pool_t::private_t::~private_t()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            quit_ = true;
+        }
+        sleep_cv_.notify_all();
+
+        for (std::thread& t : threads_) {
+            t.join();
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    int thread_pool_t::private_t::current_worker_index() const
+    {
+        return tls_pool == this ? tls_worker_index : 0;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void thread_pool_t::private_t::submit(task_t&& task)
+    {
+        unfinished_tasks_.fetch_add(1, std::memory_order_relaxed);
+
+        worker_queue_t& queue = *queues_[current_worker_index()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+
+        // Take the sleep lock before notifying, so a worker that is about to sleep can't miss the new task
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            queued_tasks_.fetch_add(1, std::memory_order_relaxed);
+        }
+        sleep_cv_.notify_one();
+    }
+
+    //---------------------------------------------------------------------------------------
+    bool thread_pool_t::private_t::try_run_task(int worker_index)
+    {
+        task_t task;
+
+        // Newest task from our own queue first, as its data is most likely to still be in the cache
+        {
+            worker_queue_t& queue = *queues_[worker_index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.head < queue.tasks.size()) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+                if (queue.head == queue.tasks.size()) {
+                    queue.tasks.clear();
+                    queue.head = 0;
+                }
+            }
+        }
+
+        // Otherwise steal the oldest task from another worker, which tends to be the largest piece of work
+        const int worker_count = (int)queues_.size();
+        for (int i = 1; !task && i < worker_count; ++i) {
+            worker_queue_t& queue = *queues_[(worker_index + i) % worker_count];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.head < queue.tasks.size()) {
+                task = std::move(queue.tasks[queue.head++]);
+                if (queue.head == queue.tasks.size()) {
+                    queue.tasks.clear();
+                    queue.head = 0;
+                }
+            }
+        }
+
+        if (!task) {
+            return false;
+        }
+
+        queued_tasks_.fetch_sub(1, std::memory_order_relaxed);
+        task(worker_index);
+
+        // Wake up `wait` when the last task is done. The lock keeps it from missing this between checking the count
+        // and going to sleep
+        if (unfinished_tasks_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.notify_all();
+        }
+        return true;
+    }
+
+    //---------------------------------------------------------------------------------------
+    void thread_pool_t::private_t::worker_loop(int worker_index)
+    {
+        tls_pool = this;
+        tls_worker_index = worker_index;
+
+        while (true) {
+            if (try_run_task(worker_index)) {
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this] { return quit_ || queued_tasks_.load(std::memory_order_relaxed) > 0; });
+            if (quit_) {
+                return;
+            }
+        }
+    }
+
+    //---------------------------------------------------------------------------------------
+    void thread_pool_t::private_t::wait()
+    {
+        const thread_pool_t::private_t* prev_pool = tls_pool;
+        tls_pool = this;
+        tls_worker_index = 0;
+
+        while (unfinished_tasks_.load(std::memory_order_acquire) > 0) {
+            if (try_run_task(0)) {
+                continue;
+            }
+
+            // The remaining tasks are running on other workers, so sleep until they're done, or one of them submits
+            // a new task that this thread can help with
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this] {
+                return unfinished_tasks_.load(std::memory_order_acquire) == 0
+                       || queued_tasks_.load(std::memory_order_relaxed) > 0;
+            });
+        }
+
+        // Any worker can end up submitting the most tasks next time, so all the queues are grown to the largest
+        // size any of them has needed
+        size_t capacity = 0;
+        for (const std::unique_ptr<worker_queue_t>& queue : queues_) {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            capacity = queue->tasks.capacity() > capacity ? queue->tasks.capacity() : capacity;
+        }
+        for (const std::unique_ptr<worker_queue_t>& queue : queues_) {
+            std::lock_guard<std::mutex> lock(queue->mutex);
+            queue->tasks.reserve(capacity);
+        }
+
+        tls_pool = prev_pool;
+    }
+
+    //=======================================================================================
+    thread_pool_t::thread_pool_t(int worker_count) : p_(new private_t(worker_count))
+    {
+    }
+
+    //---------------------------------------------------------------------------------------
+    thread_pool_t::~thread_pool_t()
+    {
+        delete p_;
+    }
+
+    //---------------------------------------------------------------------------------------
+    int thread_pool_t::worker_count() const
+    {
+        return (int)p_->queues_.size();
+    }
+
+    //---------------------------------------------------------------------------------------
+    void thread_pool_t::submit(task_t&& task)
+    {
+        p_->submit(std::move(task));
+    }
+
+    //---------------------------------------------------------------------------------------
+    void thread_pool_t::wait()
+    {
+        p_->wait();
+    }
+
+}  // namespace flexy
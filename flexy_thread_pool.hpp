@@ -0,0 +1,32 @@
+#pragma once
+
+#include <functional>
+
+namespace flexy {
+
+    //=======================================================================================
+    // A small work stealing thread pool. Each worker has its own queue, and pushes and pops tasks at the back of it.
+    // Workers that run out of tasks steal from the front of the other workers' queues.
+    // The thread calling `wait` acts as worker 0, so a pool with a worker count of N starts N-1 threads.
+    struct thread_pool_t
+    {
+        using task_t = std::function<void(int worker_index)>;
+
+        // A worker count of 0 uses one worker per hardware thread
+        thread_pool_t(int worker_count = 0);
+        ~thread_pool_t();
+
+        int worker_count() const;
+
+        // Adds a task to the queue of the calling worker. Can be called from inside a running task
+        void submit(task_t&& task);
+
+        // Runs tasks on the calling thread until all the submitted tasks are done. Only one thread at a time should
+        // submit work from outside the pool
+        void wait();
+
+        struct private_t;
+        private_t* p_ = nullptr;
+    };
+
+}  // namespace flexy
@@ -9,6 +9,7 @@
 #pragma warning(pop)
 
 #include "flexy_layout.hpp"
+#include "flexy_raylib.hpp"
 
 static int num_boxes = 3;
 static int container_alignment = 0;
@@ -51,13 +52,18 @@ void gui_test()
         float gui_contol_height = 800;
         int screen_width = GetScreenWidth();
 
-        // First create a layout for the gui controls
-        flexy::layout_t gui_layout({
+        // First create a layout for the gui controls. The layout is kept between frames and reset, so it can reuse
+        // its storage instead of allocating it again every frame. The controls hardly ever change, so the layout
+        // cache lets it reuse the previous frame's layout as well
+        static flexy::layout_t gui_layout({});
+        gui_layout.set_layout_cache(true);
+        gui_layout.reset({
             .x = screen_width - gui_control_width - 20,
             .y = 20,
             .width = gui_control_width,
             .height = gui_contol_height,
         });
+        flexy::use_raylib_scissor(gui_layout);
 
         int gui_container = gui_layout.add_item({
             .width = gui_control_width,
@@ -78,24 +84,33 @@ void gui_test()
         // add_item will now use the common config
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
-                    num_boxes = GuiSliderT(rect, TextFormat("NUM BOXES: %d", num_boxes), num_boxes, 0, 20);
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    num_boxes = GuiSliderT(
+                        flexy::to_rectangle(rect), TextFormat("NUM BOXES: %d", num_boxes), num_boxes, 0, 20);
                 },
         });
 
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
+                [=](void* userdata, const flexy::rect_t& rect) {
                     container_alignment = GuiSliderT(
-                        rect, TextFormat("CONTAINER ALIGN: %d", container_alignment), container_alignment, 0, 5);
+                        flexy::to_rectangle(rect),
+                        TextFormat("CONTAINER ALIGN: %d", container_alignment),
+                        container_alignment,
+                        0,
+                        5);
                 },
         });
 
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
+                [=](void* userdata, const flexy::rect_t& rect) {
                     container_size = GuiSliderT(
-                        rect, TextFormat("CONTAINER SIZE: %f", container_size), container_size, 100.f, 1000.f);
+                        flexy::to_rectangle(rect),
+                        TextFormat("CONTAINER SIZE: %f", container_size),
+                        container_size,
+                        100.f,
+                        1000.f);
                 },
         });
 
@@ -119,19 +134,24 @@ void gui_test()
 
         gui_layout.add_item({
             .margin = flexy::margin_t{2, 100, 0, 100},
-            .render_callback = [=](void* userdata,
-                                   const Rectangle& rect) { flex_grow = GuiCheckBox(rect, "FLEX-GROW", flex_grow); },
+            .render_callback =
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    flex_grow = GuiCheckBox(flexy::to_rectangle(rect), "FLEX-GROW", flex_grow);
+                },
         });
 
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
-                    flex_shrink = GuiCheckBox(rect, "FLEX-SHRINK", flex_shrink);
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    flex_shrink = GuiCheckBox(flexy::to_rectangle(rect), "FLEX-SHRINK", flex_shrink);
                 },
         });
 
         gui_layout.add_item({
-            .render_callback = [=](void* userdata, const Rectangle& rect) { wrap = GuiCheckBox(rect, "WRAP", wrap); },
+            .render_callback =
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    wrap = GuiCheckBox(flexy::to_rectangle(rect), "WRAP", wrap);
+                },
         });
 
         // Done with the checkbox config, so pop it
@@ -140,15 +160,16 @@ void gui_test()
         // Go back to adding items with the old config
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
-                    direction = GuiSliderT(rect, TextFormat("Direction: %d", direction), direction, 0, 1);
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    direction =
+                        GuiSliderT(flexy::to_rectangle(rect), TextFormat("Direction: %d", direction), direction, 0, 1);
                 },
         });
         gui_layout.add_item({
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
-                    item_alignment =
-                        GuiSliderT(rect, TextFormat("ITEM ALIGN: %d", item_alignment), item_alignment, 0, 3);
+                [=](void* userdata, const flexy::rect_t& rect) {
+                    item_alignment = GuiSliderT(
+                        flexy::to_rectangle(rect), TextFormat("ITEM ALIGN: %d", item_alignment), item_alignment, 0, 3);
                 },
         });
 
@@ -161,7 +182,7 @@ void gui_test()
 
         // Use the id to fecth the item rectangle
         multi_row_alignment = GuiSliderT(
-            gui_layout.get_rect_for_item(mra_id),
+            flexy::to_rectangle(gui_layout.get_rect_for_item(mra_id)),
             TextFormat("MULTI-ROW ALIGN: %d", multi_row_alignment),
             multi_row_alignment,
             0,
@@ -170,12 +191,14 @@ void gui_test()
 
     {
         // Next create a layout where we draw the boxes and the texture
-        flexy::layout_t layout({
+        static flexy::layout_t layout({});
+        layout.reset({
             .x = 20,
             .y = 20,
             .width = container_size,
             .height = 2 * container_size,
         });
+        flexy::use_raylib_scissor(layout);
 
         bool horizontal = direction == 0;
 
@@ -195,7 +218,8 @@ void gui_test()
             .container_alignment = flexy::container_alignment_t(container_alignment),
             .multi_row_alignment = flexy::container_alignment_t(multi_row_alignment),
             .item_alignment = flexy::item_alignment_t(item_alignment),
-            .render_callback = [](void* userdata, const Rectangle& rect) { DrawRectangleRec(rect, BLUE); },
+            .render_callback =
+                [](void* userdata, const flexy::rect_t& rect) { DrawRectangleRec(flexy::to_rectangle(rect), BLUE); },
         });
 
         static Color colors[] = {YELLOW, GOLD, ORANGE, PINK, RED, GREEN};
@@ -209,7 +233,10 @@ void gui_test()
                 .flex_grow = flex_grow ? 1 : 0,
                 .flex_shrink = flex_shrink ? 1 : 0,
                 .margin = flexy::margin_t{5, 5, 0, 5},
-                .render_callback = [=](void* userdata, const Rectangle& rect) { DrawRectangleRec(rect, col); },
+                .render_callback =
+                    [=](void* userdata, const flexy::rect_t& rect) {
+                        DrawRectangleRec(flexy::to_rectangle(rect), col);
+                    },
             });
         }
 
@@ -239,7 +266,7 @@ void gui_test()
             .width = 500.f,
             .height = 500.f,
             .render_callback =
-                [=](void* userdata, const Rectangle& rect) {
+                [=](void* userdata, const flexy::rect_t& rect) {
                     UpdateTexture(test_texture, pixels);
                     DrawTexture(test_texture, (int)rect.x, (int)rect.y, WHITE);
                 },